@@ -0,0 +1,155 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc.h"
+#include "decode.h"
+#include "cycleprof.h"
+
+#define ADMUX_REFS	(_BV(REFS2) | _BV(REFS1) | _BV(REFS0))
+
+volatile uint16_t adcValue[ADC_CHANNELS];
+volatile uint8_t adcDecoded[ADC_LADDERS];
+volatile uint8_t adcTempReady;
+volatile uint8_t adcOverruns;
+volatile uint8_t adcChains;
+
+static const uint8_t channelMux[ADC_CHANNELS] = {ADMUX_LADDER1, ADMUX_LADDER2, ADMUX_TEMP};
+
+static uint8_t chain[ADC_CHANNELS];
+static uint8_t chainLength;
+static uint8_t slot;
+static uint8_t discard;
+static volatile uint8_t busy;
+static volatile uint8_t tempRequested;
+
+void ADCInit()
+{
+  /* this function initialises the ADC 
+
+        ADC Notes
+	
+	Prescaler
+	
+	ADC Prescaler needs to be set so that the ADC input frequency is between 50 - 200kHz.
+	
+	Example prescaler values for various frequencies
+	
+	Clock   Available prescaler values
+   ---------------------------------------
+	 1 MHz   8 (125kHz), 16 (62.5kHz)
+	 4 MHz   32 (125kHz), 64 (62.5kHz)
+	 8 MHz   64 (125kHz), 128 (62.5kHz)
+	16 MHz   128 (125kHz)
+
+   the prescaler is picked from F_CPU in timing.h, 64 for mcu running at 8MHz so that
+   every channel fits in one tick
+
+
+  */
+
+  ADMUX =
+            (0 << ADLAR) |     // right shift result
+            (0 << REFS1) |     // Sets ref. voltage to VCC, bit 1
+            (0 << REFS0) |     // Sets ref. voltage to VCC, bit 0
+            (0 << MUX3)  |     // use ADC2 for input (PB4), MUX bit 3
+            (0 << MUX2)  |     // use ADC2 for input (PB4), MUX bit 2
+            (1 << MUX1)  |     // use ADC2 for input (PB4), MUX bit 1
+            (0 << MUX0);       // use ADC2 for input (PB4), MUX bit 0
+
+  ADCSRA = 
+            (1 << ADEN)  |     // Enable ADC 
+            (1 << ADIE)  |     // conversion complete interrupt drives the scheduler
+            ADC_PRESCALE_BITS; // ADPS2:0
+
+  // ladder pins are analogue only
+  DIDR0 = _BV(ADC2D)
+#if OPT_LADDER2
+          | _BV(ADC3D)
+#endif
+          ;
+}
+
+static void select(uint8_t channel)
+{
+	uint8_t mux = channelMux[channel];
+
+	// the first conversion after a reference change can't be trusted
+	discard = ((ADMUX ^ mux) & ADMUX_REFS) != 0;
+	ADMUX = mux;
+	ADCSRA |= (1 << ADSC);
+}
+
+// Called from the tick ISR
+void ADCStart()
+{
+	if (busy) {
+		adcOverruns++;
+		return;
+	}
+
+	chainLength = 0;
+	chain[chainLength++] = ADC_LADDER1;
+#if OPT_LADDER2
+	chain[chainLength++] = ADC_LADDER2;
+#endif
+	if (tempRequested) {
+		tempRequested = 0;
+		chain[chainLength++] = ADC_TEMP;
+	}
+
+	busy = 1;
+	slot = 0;
+	select(chain[0]);
+}
+
+// Ask for a temperature reading in the next tick's chain
+void ADCRequestTemp()
+{
+	tempRequested = 1;
+}
+
+ISR(ADC_vect)
+{
+	uint16_t val;
+	uint8_t channel;
+
+	PROF_BEGIN(PROF_ADC);
+	val = ADC;
+
+	if (discard) {
+		discard = 0;
+		ADCSRA |= (1 << ADSC);
+		PROF_END(PROF_ADC);
+		return;
+	}
+
+	channel = chain[slot];
+	adcValue[channel] = val;
+
+	PROF_BEGIN(PROF_DECODE);
+	if (channel == ADC_LADDER1) {
+		adcDecoded[0] = DecodeAnalogue(val);
+	}
+#if OPT_LADDER2
+	else if (channel == ADC_LADDER2) {
+		adcDecoded[1] = DecodeAnalogue2(val);
+	}
+#endif
+	else {
+		adcTempReady = 1;
+	}
+	PROF_END(PROF_DECODE);
+
+	if (++slot < chainLength) {
+		select(chain[slot]);
+	} else {
+		busy = 0;
+		adcChains++;
+	}
+	PROF_END(PROF_ADC);
+}
@@ -0,0 +1,61 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+ADC acquisition scheduler.
+
+Each tick the Timer1 ISR starts a chain of conversions that the ADC interrupt runs through on its own:
+	ladder 1 (ADC2, PB4), ladder 2 (ADC3, PB3, OPT_LADDER2), temperature (ADC4, when requested by osctrim)
+so the conversions overlap whatever the main loop is doing and every channel is sampled every tick.
+A ladder result is decoded in the interrupt as soon as it lands, which keeps adcDecoded[] current even
+while the main loop is busy sending a command.
+
+Switching channel with the same reference needs no settling for a source as stiff as the ladder (the
+sample and hold gets its 1.5 ADC clocks after the mux change), but switching reference does, so the
+first conversion after a reference change is thrown away.
+*/
+
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+#include "config.h"
+#include "timing.h"
+
+enum {ADC_LADDER1, ADC_LADDER2, ADC_TEMP, ADC_CHANNELS};
+
+#if OPT_LADDER2
+#define ADC_LADDERS		2
+#else
+#define ADC_LADDERS		1
+#endif
+
+// Vcc reference, right adjusted
+#define ADMUX_LADDER1	(_BV(MUX1))					// ADC2 (PB4)
+#define ADMUX_LADDER2	(_BV(MUX1) | _BV(MUX0))		// ADC3 (PB3)
+// 1.1v internal reference, right adjusted
+#define ADMUX_TEMP		(_BV(REFS1) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1) | _BV(MUX0))	// ADC4 temperature
+
+// Worst tick: each ladder, plus a temperature reading and the conversion thrown away before it
+#define ADC_MAX_CONVERSIONS	(ADC_LADDERS + 2 * OPT_OSCTRIM)
+#define ADC_CONVERSION_NS	(13ULL * (1UL << ADC_PRESCALE_BITS) * 1000000000ULL / F_CPU)
+
+// leave an eighth of the tick for the latency of restarting each conversion from the interrupt
+#if ADC_MAX_CONVERSIONS * ADC_CONVERSION_NS > TICK_NS * 7 / 8
+#error "ADC conversions don't fit in a tick"
+#endif
+
+extern volatile uint16_t adcValue[ADC_CHANNELS];	// last raw result per channel
+extern volatile uint8_t adcDecoded[ADC_LADDERS];	// decoded button state per ladder
+extern volatile uint8_t adcTempReady;				// set when adcValue[ADC_TEMP] is new
+extern volatile uint8_t adcOverruns;				// chains still running when the next tick came
+extern volatile uint8_t adcChains;					// chains finished, wraps
+
+void ADCInit();
+void ADCStart();
+void ADCRequestTemp();
+
+#endif
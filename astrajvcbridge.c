@@ -30,20 +30,42 @@ RSTDISBL = [ ]
 DWEN = [ ]
 SPIEN = [X]
 WDTON = [ ]
-EESAVE = [ ]
+EESAVE = [X]
 BODLEVEL = 4V3
 CKDIV8 = [ ]
 CKOUT = [ ]
 SUT_CKSEL = INTRCOSC_8MHZ_6CK_14CK_64MS
 EXTENDED = 0xFF (valid)
-HIGH = 0xDC (valid)
+HIGH = 0xD4 (valid)
 LOW = 0xE2 (valid)
 
+Fast start fuses: the bridge is powered from the amplifier line so it cold boots every time the radio is
+turned on.  With the brown-out detector holding reset until VCC is past 4.3V the 64ms start-up delay isn't
+needed, so the supported fast profile is the same with
+SUT_CKSEL = INTRCOSC_8MHZ_6CK_14CK_0MS
+LOW = 0xC2 (valid)
+Only use it with BODLEVEL set.
+
+Startup budget, from VCC good to the first command starting on the wire (8MHz, KD-X351BT tick):
+	start-up delay		64ms stock fuses, 0 with LOW = 0xC2, plus 6 + 14 clocks
+	C runtime			.data / .bss init, a few us
+	main() to sei()		Timer1, decode windows and ADC only; tens of us (decodeBuild() adds to it with OPT_CHORDS)
+	first sample		started before sei(), decoded before the first tick (527us)
+	debounce			DEBOUNCE_TICKS ticks (2.6ms)
+	first frame			the tick after, once the line has been idle JVC_IDLE_TICKS, which it has by then
+so ~4ms with the fast fuses and ~68ms without.  The keymap is loaded after sei() as nothing needs it until the
+main loop.  A button already held at power up is sent when it is let go (unless it is held long enough to
+start learning mode).  With OPT_TELEMETRY the TLM_BOOT record reports the measured figures.
+
 The processing steps are:
 1. Read ADC values
 2. Translate ADC values using tolerances to a command
 3. Debounce the command for 5ms (done in the ISR to ensure consistent timing)
-4. Process the debounced command in a state machine in main() to allow sequenced codes and delays as required
+4. Map the debounced command to JVC codes through the keymap table (keymap.c) to allow hold codes and repeat delays as required
+
+EESAVE keeps the learnt calibration in EEPROM across reprogramming.
+To learn the ADC values for a different car or resistor: hold any button while powering up for ~1s, release,
+wait a moment, then hold each button for ~0.5s in the order up, back, fwd, O/0, +, -.  See calibrate.h.
 
 See https://www.avforums.com/threads/jvc-stalk-adapter-diy.248455/ for the raw protocol details.
 
@@ -64,43 +86,21 @@ O/0		283			Sound		0x06		391
 #include "bitmacros.h"
 #include "bitNames.h"
 #include "debounce.h"
-
-#define true (!0)
-#define false (0)
-
-// Voltage values, assuming vref = 5v
-#define CAR_IDLE	910
-#define CAR_SOUND	391
-#define CAR_VOLDN	157
-#define CAR_VOLUP	269
-#define CAR_UPARR	780
-#define CAR_BKARR	648
-#define CAR_FDARR	516
-
-// JVC Commands
-#define JVC_VOLUP	0x04
-#define JVC_VOLDN	0x05
-#define	JVC_SOUND	0x0D
-#define JVC_SRC		0x08
-#define JVC_SKIPBK	0x11
-#define JVC_SKIPFD	0x12
-#define JVC_SKIPBKH 0x13
-#define JVC_SKIPFDH 0x14
-
-// States
-enum {VAL_IDLE, VAL_VOLUP, VAL_VOLDN, VAL_SRC, VAL_SEEKFWD, VAL_SEEKBK, VAL_SOUND};
-
-// Calcs for ADC thresholds for handling values
-// Vref = 5v
-// 10 bits = 1024
-// 1 bit = ~0.005V
-// +-0.1V = 15
-#define TOLLERANCE	30
-
-void JVCCommand(unsigned char cmd);
-void ADCInit();
-uint16_t ADCRead();
-uint8_t DecodeAnalogue(uint16_t adcVal);
+#include "decode.h"
+#include "config.h"
+#include "cycleprof.h"
+#include "telemetry.h"
+#include "calibrate.h"
+#include "jvc.h"
+#include "keymap.h"
+#include "settings.h"
+#include "osctrim.h"
+#include "timing.h"
+#include "tickcal.h"
+#include "adc.h"
+#include "encoder.h"
+#include "watchdog.h"
+#include "stackmon.h"
 
 // time tick variables used for interval timer
 static volatile unsigned long uptime = 0L;
@@ -109,250 +109,284 @@ static volatile unsigned long target;
 // time tick variables used for 1ms interval timer
 volatile unsigned char tick = 0;
 debounceData cDebounce;
+#if OPT_LADDER2
+debounceData cDebounce2;
+#endif
+#if OPT_ADAPTIVE_DEBOUNCE
+debounceNoise cNoise;	// updated by the tick ISR only
+#if OPT_LADDER2
+debounceNoise cNoise2;
+#endif
+#endif
+#if OPT_DIGITAL
+debounceBits cDigital;	// updated by the tick ISR only
+#endif
 volatile unsigned char cCombined = 0, cCombinedLast = 0;
-uint8_t decodedValue = VAL_IDLE;
+#if OPT_TELEMETRY
+static volatile uint16_t bootTicks;	// ticks since Timer1 started, stops at 0xFFFF
+#endif
+
+// Debounce each ladder on its own; the first ladder wins if both have something held, then the second,
+// then the lowest numbered digital button
+static uint8_t debounceLadders()
+{
+	uint8_t state = getDebounced(&cDebounce, adcDecoded[0]);
+#if OPT_LADDER2
+	uint8_t state2 = getDebounced(&cDebounce2, adcDecoded[1]);
+	if (state == VAL_IDLE) {
+		state = state2;
+	}
+#endif
+#if OPT_DIGITAL
+	if (state == VAL_IDLE && cDigital.state) {
+		uint8_t pin = 1;
+		while (!(cDigital.state & (1 << pin))) {
+			pin++;
+		}
+		state = VAL_DIG1 + pin - 1;
+	}
+#endif
+	return state;
+}
 
 void waitForTick(uint16_t count)
 {
+#if OPT_WATCHDOG
+	uint8_t stage = watchdogStage;
+
+	WATCHDOG_STAGE(WDT_STAGE_WAIT_TICK);
+#endif
 	for (; count > 0; count--) {
 		while (tick == 0) /* wait for ISR */;
 		tick = 0;
+		WATCHDOG_RESET();
 	}
+	WATCHDOG_STAGE(stage);
 }
 
 // 527us
 ISR(TIMER1_COMPA_vect)
 {
+	PROF_BEGIN(PROF_ISR);
+#if OPT_TICKCAL
+	tickcalISR();
+#endif
+	if (tick) {
+		PROF_MISSED_TICK();
+	}
 	tick = 1;
+#if OPT_TELEMETRY
+	if (bootTicks != 0xFFFF) {
+		bootTicks++;
+	}
+#endif
+
+	// the JVC line changes first, so its edges sit at a fixed point after the compare
+	JVCTick(cCombined);
 	
-	cCombined = getDebounced(&cDebounce, decodedValue);
+	// conversions for this tick run under ADC_vect while everything else carries on
+	ADCStart();
+#if OPT_DIGITAL
+	// buttons pull their pin low
+	updateDebouncedBits(&cDigital, ~PINB & OPT_DIGITAL);
+#endif
+	cCombined = debounceLadders();
+#if OPT_ADAPTIVE_DEBOUNCE
+	// last tick's readings, the ones just debounced
+	debounceAdapt(&cDebounce, &cNoise, adcValue[ADC_LADDER1], adcDecoded[0]);
+#if OPT_LADDER2
+	debounceAdapt(&cDebounce2, &cNoise2, adcValue[ADC_LADDER2], adcDecoded[1]);
+#endif
+#endif
+	PROF_END(PROF_ISR);
 }
 
 int main(void)
 {
-	uint16_t adcVal;
+	uint8_t code, prio;
+	uint8_t retryCode = KEY_NONE, retryPrio = JVC_PRIO_PRESS;	// turned away by a full queue
+#if OPT_TELEMETRY
+	uint8_t preSei;
+	uint16_t bootLoop;
+	uint8_t bootReported = 0;
+#endif
+#if OPT_CALIBRATE
+	uint8_t bootPress;
+#endif
+#if OPT_WATCHDOG && OPT_CALIBRATE
+	uint8_t restart = watchdogInit();
+#elif OPT_WATCHDOG
+	watchdogInit();
+#endif
+
+#if OPT_TIMER1_PLL
+	// Timer1 from the 64MHz PLL: enable, let it stabilise, wait for lock, then switch over
+	PLLCSR = _BV(PLLE);
+	_delay_us(100);
+	while (!(PLLCSR & _BV(PLOCK)));
+	PLLCSR |= _BV(PCKE);
+#endif
+
+	// Set up Timer1 for 527us interrupts, see timing.h.  First, so the first tick is as early as it can be
+	// and TCNT1 times everything up to sei().
+	OCR1A = TIMER1_OCR;
+	OCR1C = TIMER1_OCR;
+	TCCR1 = TIMER1_CS | _BV(CTC1);
+	_setBit(TIMSK, OCIE1A);
 
-	
 	/* Define pull-ups and set outputs high */
 	/* Define directions for port pins */
 	DDRB =  0b00000000;
-	PORTB = 0b00000000; //1 for pullup
-	
-	// 5ms debounce, idle value is high, one shot is disabled (keep reporting the triggered value repeatedly)
-	initDebounce(&cDebounce, 5, VAL_IDLE, 0);
-
-	// Set up Timer1 for 527us interrupts
-	OCR1A = (F_CPU / 4 / (128UL * (527UL - 67UL))) - 1;
-	OCR1C = (F_CPU / 4 / (128UL * (527UL - 67UL))) - 1;
-	TCCR1 = _BV(CS13) | _BV(CTC1);
-	_setBit(TIMSK, OCIE1A);
+	PORTB = 0b00000000 | OPT_DIGITAL; //1 for pullup
 	
+	// DEBOUNCE_TICKS debounce, idle value is high, one shot is disabled (keep reporting the triggered value repeatedly)
+	initDebounce(&cDebounce, DEBOUNCE_TICKS, VAL_IDLE, 0);
+#if OPT_LADDER2
+	initDebounce(&cDebounce2, DEBOUNCE_TICKS, VAL_IDLE, 0);
+#endif
+#if OPT_ADAPTIVE_DEBOUNCE
+	initDebounceNoise(&cNoise);
+#if OPT_LADDER2
+	initDebounceNoise(&cNoise2);
+#endif
+#endif
+
+	// the ADC interrupt decodes from the first conversion on
+	decodeInit();
 	ADCInit();
-
+#if OPT_CYCLEPROF
+	profInit();
+#endif
+#if OPT_TELEMETRY
+	tlmInit();
+#endif
+#if OPT_TICKCAL
+	tickcalInit();
+#endif
+
+	// the first conversion runs while the first tick counts down, so that tick already has a sample
+	ADCStart();
+#if OPT_TELEMETRY
+	preSei = (TIFR & _BV(OCF1A)) ? 0xFF : TCNT1;
+#endif
 	sei();	// Enable global interrupts
+#if OPT_WATCHDOG
+	TLM_RESET(watchdogLast.cause, watchdogLast.stage, watchdogLast.resets);
+#endif
+
+	// nothing needs the keymap until the main loop
+	settingsLoadKeymap();
+#if OPT_CHORDS
+	settingsLoadChordmap();
+#endif
+
+#if OPT_CALIBRATE
+	// a button held through power up isn't lost, it goes out as a press once it is let go
+	WATCHDOG_STAGE(WDT_STAGE_CALIBRATE);
+#if OPT_WATCHDOG
+	bootPress = calibrateStartup(!restart);
+#else
+	bootPress = calibrateStartup(1);
+#endif
+	WATCHDOG_STAGE(WDT_STAGE_INIT);
+	if (bootPress != VAL_IDLE) {
+		code = keymapDispatch(bootPress, 1);
+		if (code != KEY_NONE) {
+			JVCQueue(code, JVCPriority(code), VAL_IDLE);
+		}
+	}
+#endif
+#if OPT_OSCTRIM
+	osctrimInit();
+#endif
+#if OPT_ENCODER
+	encoderInit();
+#endif
+#if OPT_TELEMETRY
+	bootLoop = bootTicks;
+#endif
+	WATCHDOG_STAGE(WDT_STAGE_IDLE);
 
 	while(1) {
 		/* 
-		This will be executed every 527us, unless waitForTick clears it during a send sequence
+		This will be executed every 527us; JVC commands go out from the tick ISR so nothing here waits for them
 		*/
 		if (tick == 1) {
+			PROF_BEGIN(PROF_LOOP);
+			// if the ticks or the ADC chain stop, or a pass never finishes, the watchdog resets us, see watchdog.h
+			WATCHDOG_RESET();
 			
-			adcVal = ADCRead();
-			decodedValue = DecodeAnalogue(adcVal);
+#if OPT_OSCTRIM
+			WATCHDOG_STAGE(WDT_STAGE_SERVICE);
+			// the temperature rides along in the next tick's conversions, after the ladders
+			if (osctrimTick()) {
+				ADCRequestTemp();
+			}
+			if (adcTempReady) {
+				adcTempReady = 0;
+				osctrimSample(adcValue[ADC_TEMP]);
+			}
+#endif
 			
 			// see ISR for this as well - this only retrieves the value; it does not update it
 			tick = 0;
+			WATCHDOG_STAGE(WDT_STAGE_DEBOUNCE);
+			PROF_BEGIN(PROF_DEBOUNCE);
 			cli();
-			cCombined = getDebounced(&cDebounce, decodedValue);
+			cCombined = debounceLadders();
 			sei();
+			PROF_END(PROF_DEBOUNCE);
 
-			//VAL_SRC, 
-			switch (cCombined) {
-				case VAL_SEEKFWD:
-					/* Seek: This could have been held in which case a different code is required */
-					if (cCombined != cCombinedLast) {
-						/* first time */
-						JVCCommand(JVC_SKIPFD);
-					} else {
-						/* held */
-						JVCCommand(JVC_SKIPFD); /* KD-X351BT: this needs to be the original code repeated */
-					}
-					break;
-					
-				case VAL_SEEKBK:
-					/* Seek: This could have been held in which case a different code is required */
-					if (cCombined != cCombinedLast) {
-						/* first time */
-						JVCCommand(JVC_SKIPBK);
-						} else {
-						/* held */
-						JVCCommand(JVC_SKIPBKH); /* KD-X351BT: this needs to be the alternate code */
-					}
-					break;
-
-				case VAL_VOLUP:
-					JVCCommand(JVC_VOLUP);
-					waitForTick(400UL);
-					break;
-					
-				case VAL_VOLDN:
-					JVCCommand(JVC_VOLDN);
-					waitForTick(400UL);
-					break;
-					
-				case VAL_SRC:
-					/* Only send a code once per button press */
-					if (cCombined != cCombinedLast) {
-						/* first time */
-						JVCCommand(JVC_SRC);
-					}
-					break;
-					
-				case VAL_SOUND:
-					/* Only send a code once per button press */
-					if (cCombined != cCombinedLast) {
-						/* first time */
-						JVCCommand(JVC_SOUND);
+			WATCHDOG_STAGE(WDT_STAGE_DISPATCH);
+			PROF_BEGIN(PROF_DISPATCH);
+
+			// a press the queue turned away goes in ahead of anything new, and until it has the keymap waits, so
+			// the next state change is still seen (hold repeats are never worth keeping)
+			if (retryCode != KEY_NONE && JVCQueue(retryCode, retryPrio, cCombined)) {
+				retryCode = KEY_NONE;
+			}
+			if (retryCode == KEY_NONE) {
+				code = keymapDispatch(cCombined, !JVCBusy());
+				if (code != KEY_NONE) {
+					prio = keymapRepeating() ? JVC_PRIO_REPEAT : JVCPriority(code);
+					if (!JVCQueue(code, prio, cCombined) && prio != JVC_PRIO_REPEAT) {
+						retryCode = code;
+						retryPrio = prio;
 					}
-					break;
-					
-				case VAL_IDLE:
-					/* Idle - do nothing */
-					break;
+				}
 			}
+#if OPT_ENCODER
+			// detents stay counted in encoderSteps until nothing else is waiting, one step queued at a time, so
+			// spinning the knob can't fill the queue with volume (the highest class) and shut presses out
+			if (retryCode == KEY_NONE && !JVCWaiting(JVC_PRIO_PRESS)) {
+				int8_t step = encoderTake();
+				if (step) {
+					JVCQueue(step > 0 ? HU_VOLUP : HU_VOLDN, JVC_PRIO_VOLUME, VAL_IDLE);
+				}
+			}
+#endif
+			if (cCombined != cCombinedLast) {
+				TLM_DEBOUNCE(cCombinedLast, cCombined);
+			}
+#if OPT_TELEMETRY
+			if (!bootReported && cCombined != VAL_IDLE) {
+				TLM_BOOT(preSei, bootLoop, bootTicks);
+				bootReported = 1;
+			}
+#endif
 			cCombinedLast = cCombined;
+			PROF_END(PROF_DISPATCH);
+
+			WATCHDOG_STAGE(WDT_STAGE_SERVICE);
+#if OPT_TICKCAL
+			tickcalService();
+#endif
+			STACKMON_TICK();
+			TLM_SERVICE(adcValue[ADC_LADDER1], adcDecoded[0]);
+			WATCHDOG_STAGE(WDT_STAGE_IDLE);
+			PROF_END(PROF_LOOP);
 		}
 	}
 
 	return 0;
 }
-
-
-void JVCPulseLengthEncoding(unsigned char val) {
-	_movNamedBitNoPullUp(JVC, 0);
-	waitForTick(1);
-	_movNamedBitNoPullUp(JVC, 1);
-	waitForTick(1);
-	if (val != 0) {
-		waitForTick(2);
-	}
-}
-
-void JVC7BitByte(unsigned char cmd) {
-	JVCPulseLengthEncoding(cmd & 0b00000001);
-	JVCPulseLengthEncoding(cmd & 0b00000010);
-	JVCPulseLengthEncoding(cmd & 0b00000100);
-	JVCPulseLengthEncoding(cmd & 0b00001000);
-	JVCPulseLengthEncoding(cmd & 0b00010000);
-	JVCPulseLengthEncoding(cmd & 0b00100000);
-	JVCPulseLengthEncoding(cmd & 0b01000000);
-}
-
-void JVCCommand(unsigned char cmd) {
-	for (int i = 1; i <= 3; i++) {
-		// Header
-		_movNamedBitNoPullUp(JVC, 1);		// Bus reset
-		waitForTick(1);
-		
-		_movNamedBitNoPullUp(JVC, 0);     // AGC
-		waitForTick(16);
-		
-		_movNamedBitNoPullUp(JVC, 1);     // AGC
-		waitForTick(8);
-		
-		JVCPulseLengthEncoding(1);    // 1 Start Bit
-		
-		JVC7BitByte(0x47);
-
-		//Body
-		JVC7BitByte(cmd);
-		
-		//Footer
-		JVCPulseLengthEncoding(1);
-		JVCPulseLengthEncoding(1);    // 2 stop bits
-	}
-}
-
-void ADCInit()
-{
-  /* this function initialises the ADC 
-
-        ADC Notes
-	
-	Prescaler
-	
-	ADC Prescaler needs to be set so that the ADC input frequency is between 50 - 200kHz.
-	
-	Example prescaler values for various frequencies
-	
-	Clock   Available prescaler values
-   ---------------------------------------
-	 1 MHz   8 (125kHz), 16 (62.5kHz)
-	 4 MHz   32 (125kHz), 64 (62.5kHz)
-	 8 MHz   64 (125kHz), 128 (62.5kHz)
-	16 MHz   128 (125kHz)
-
-   below example set prescaler to 128 for mcu running at 8MHz
-
-
-  */
-
-  ADMUX =
-            (0 << ADLAR) |     // right shift result
-            (0 << REFS1) |     // Sets ref. voltage to VCC, bit 1
-            (0 << REFS0) |     // Sets ref. voltage to VCC, bit 0
-            (0 << MUX3)  |     // use ADC2 for input (PB4), MUX bit 3
-            (0 << MUX2)  |     // use ADC2 for input (PB4), MUX bit 2
-            (1 << MUX1)  |     // use ADC2 for input (PB4), MUX bit 1
-            (0 << MUX0);       // use ADC2 for input (PB4), MUX bit 0
-
-  ADCSRA = 
-            (1 << ADEN)  |     // Enable ADC 
-            (1 << ADPS2) |     // set prescaler to 128, bit 2 
-            (1 << ADPS1) |     // set prescaler to 128, bit 1 
-            (1 << ADPS0);      // set prescaler to 128, bit 0  
-}
-
-uint16_t ADCRead()
-{
-	uint16_t val;
-	ADCSRA |= (1 << ADSC);         // start ADC measurement
-	while (ADCSRA & (1 << ADSC) ); // wait till conversion complete
-
-	val = (uint16_t)ADCL;
-	val |= ((uint16_t)ADCH) << 8;
-	
-	return val;
-}
-
-
-uint8_t inRange(uint16_t adcVal, uint16_t value, uint16_t tollerance)
-{
-	volatile uint16_t lower, upper;
-	volatile int16_t chk;
-	chk = (signed)value - (signed)tollerance;
-	
-	if (chk <= 0) {
-		lower = 0;
-	} else {
-		lower = value - tollerance;
-	}
-	
-	upper = value + tollerance;
-	
-	if (adcVal >= lower  && adcVal <= upper)
-		return true;
-	else
-		return false;
-}
-
-uint8_t DecodeAnalogue(uint16_t adcVal)
-{
-	if (inRange(adcVal, CAR_VOLUP, TOLLERANCE)) return VAL_VOLUP;
-	if (inRange(adcVal, CAR_VOLDN, TOLLERANCE)) return VAL_VOLDN;
-	if (inRange(adcVal, CAR_UPARR, TOLLERANCE)) return VAL_SRC;
-	if (inRange(adcVal, CAR_FDARR, TOLLERANCE)) return VAL_SEEKFWD;
-	if (inRange(adcVal, CAR_BKARR, TOLLERANCE)) return VAL_SEEKBK;
-	if (inRange(adcVal, CAR_SOUND, TOLLERANCE)) return VAL_SOUND;
-	return VAL_IDLE;	
-}
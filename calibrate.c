@@ -0,0 +1,165 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "calibrate.h"
+
+#if OPT_CALIBRATE
+
+#include <avr/interrupt.h>
+#include "adc.h"
+#include "debounce.h"
+#include "decode.h"
+#include "settings.h"
+#include "watchdog.h"
+
+extern void waitForTick(uint16_t count);
+
+// The tick ISR starts a ladder conversion each tick; this is the one finished during the previous tick
+static uint16_t sample(void)
+{
+	uint16_t val;
+
+	waitForTick(1);
+	cli();
+	val = adcValue[ADC_LADDER1];
+	sei();
+	return val;
+}
+
+// Measure a steady reading: CAL_SAMPLES samples that all stay on the same side of threshold.
+// Returns 0 if the line crossed threshold part way through.
+static uint8_t measure(calEntry *entry, uint16_t threshold, uint8_t pressed)
+{
+	uint32_t sum = 0;
+	uint16_t min = 0xFFFF, max = 0, val;
+
+	for (uint16_t i = 0; i < CAL_SAMPLES; i++) {
+		val = sample();
+		if ((val < threshold) != pressed) {
+			return 0;
+		}
+		sum += val;
+		if (val < min) min = val;
+		if (val > max) max = val;
+	}
+
+	entry->mean = sum / CAL_SAMPLES;
+	entry->spread = (max - min) > 0xFF ? 0xFF : (max - min);
+	return 1;
+}
+
+// Wait until the line has been on the wanted side of threshold for CAL_SETTLE_TICKS. Returns 0 on timeout.
+static uint8_t waitFor(uint16_t threshold, uint8_t pressed)
+{
+	uint16_t steady = 0;
+
+	for (uint16_t t = 0; t < CAL_TIMEOUT_TICKS; t++) {
+		if ((sample() < threshold) == pressed) {
+			if (++steady >= CAL_SETTLE_TICKS) {
+				return 1;
+			}
+		} else {
+			steady = 0;
+		}
+	}
+	return 0;
+}
+
+static uint16_t halfWidth(const calEntry *entry)
+{
+	return CAL_HALF_WIDTH(entry->spread);
+}
+
+// Windows must step down from idle without touching each other
+static uint8_t valid(const calBlock *cal)
+{
+	uint16_t limit = cal->idle.mean - halfWidth(&cal->idle);
+
+	for (uint8_t i = 0; i < DECODE_BUTTONS; i++) {
+		uint16_t tol = halfWidth(&cal->button[i]);
+		if (cal->button[i].mean + tol >= limit) {
+			return 0;
+		}
+		limit = cal->button[i].mean - tol;
+	}
+	return 1;
+}
+
+// The ADC interrupt decodes against the table, so swap it in with interrupts off
+static void apply(const calBlock *cal)
+{
+	cli();
+	for (uint8_t i = 0; i < DECODE_BUTTONS; i++) {
+		decodeSetWindow(i, cal->button[i].mean, halfWidth(&cal->button[i]));
+	}
+	decodeBuild();
+	sei();
+}
+
+static void learn(void)
+{
+	calBlock cal;
+	uint16_t threshold = (LADDER_IDLE_ADC + decodeDefaultCentre(0)) / 2;
+
+	// let go of the button that got us here
+	if (!waitFor(threshold, 0)) return;
+	if (!measure(&cal.idle, threshold, 0)) return;
+
+	threshold = cal.idle.mean - cal.idle.spread - CAL_PRESS_DELTA;
+
+	for (uint8_t i = 0; i < DECODE_BUTTONS; ) {
+		if (!waitFor(threshold, 1)) return;
+		if (measure(&cal.button[i], threshold, 1)) {
+			i++;
+		}
+		if (!waitFor(threshold, 0)) return;
+	}
+
+	if (valid(&cal)) {
+		WATCHDOG_STAGE(WDT_STAGE_EEPROM);
+		settingsSaveCal(&cal);
+		WATCHDOG_STAGE(WDT_STAGE_CALIBRATE);
+		apply(&cal);
+	}
+}
+
+// Call once interrupts are running, after decodeInit().  Returns the button that was held at power up and
+// let go before learning mode started, so main() can still send it, or VAL_IDLE.  Like any other press it
+// has to decode the same for DEBOUNCE_TICKS samples in a row; a glitch or the readings on the way out of a
+// press don't count.  With learning 0 (restarting after a watchdog reset) the windows are loaded and nothing
+// else: whatever is held was held before the reset.
+uint8_t calibrateStartup(uint8_t learning)
+{
+	calBlock cal;
+	uint16_t threshold = (LADDER_IDLE_ADC + decodeDefaultCentre(0)) / 2;
+	uint8_t held = VAL_IDLE, last = VAL_IDLE, run = 0;
+
+	if (settingsLoadCal(&cal) && valid(&cal)) {
+		apply(&cal);
+	}
+	if (!learning) {
+		return VAL_IDLE;
+	}
+
+	for (uint16_t ticks = 0; sample() < threshold; ) {
+		uint8_t state = adcDecoded[0];
+
+		if (state != last) {
+			last = state;
+			run = 0;
+		}
+		if (run < DEBOUNCE_TICKS && ++run == DEBOUNCE_TICKS && state != VAL_IDLE) {
+			held = state;
+		}
+		if (++ticks >= CAL_ENTRY_TICKS) {
+			learn();
+			return VAL_IDLE;
+		}
+	}
+	return held;
+}
+
+#endif
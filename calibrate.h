@@ -0,0 +1,45 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Per-install ADC calibration.
+
+At power up the learnt windows are loaded from EEPROM (if there are any) in place of the ladder profile defaults.
+
+Learning mode: hold any button while the radio powers up and keep holding it for ~1s, then release.
+Leave the wheel alone for a moment while idle is measured, then press and hold each button in turn for
+~0.5s in this order: up (Source), back, fwd, O/0 (Sound), +, -.
+After the last one the result is checked (no overlapping windows) and saved, and the bridge carries on
+normally.  30s without a press abandons learning and keeps whatever was there before.
+*/
+
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "decode.h"
+
+// All in ticks (~527us)
+#define CAL_ENTRY_TICKS		1900	// button held at power up for this long enters learning mode
+#define CAL_SETTLE_TICKS	40		// ignore the bounce after each press and release
+#define CAL_SAMPLES			256		// samples averaged per button
+#define CAL_TIMEOUT_TICKS	57000U	// give up waiting for a press
+
+// A reading this far below idle counts as pressed while learning
+#define CAL_PRESS_DELTA		40
+
+// Learnt window half width is spread / 2 + CAL_MARGIN, kept within CAL_MIN_TOLLERANCE..TOLLERANCE
+#define CAL_MARGIN			6
+#define CAL_MIN_TOLLERANCE	10
+#define CAL_HALF_WIDTH(spread)	((spread) / 2 + CAL_MARGIN < CAL_MIN_TOLLERANCE ? CAL_MIN_TOLLERANCE \
+								: (spread) / 2 + CAL_MARGIN > TOLLERANCE ? TOLLERANCE : (spread) / 2 + CAL_MARGIN)
+
+#if OPT_CALIBRATE
+uint8_t calibrateStartup(uint8_t learning);
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Build options.
+Everything here defaults to the plain production build.  Override on the compiler command line,
+e.g. avr-gcc ... -DOPT_CYCLEPROF=1, rather than editing this file for a one-off build.
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Cycle budget profiler (cycleprof.c).  Uses Timer0 as a free running timebase.
+#ifndef OPT_CYCLEPROF
+#define OPT_CYCLEPROF	0
+#endif
+
+// Binary telemetry out of the USI DO pin (telemetry.c).  Shares the Timer0 timebase.
+#ifndef OPT_TELEMETRY
+#define OPT_TELEMETRY	0
+#endif
+
+// EEPROM calibration of the ladder windows and power up learning mode (calibrate.c)
+#ifndef OPT_CALIBRATE
+#define OPT_CALIBRATE	1
+#endif
+
+// Temperature compensated OSCCAL from a per chip table in EEPROM (osctrim.c)
+#ifndef OPT_OSCTRIM
+#define OPT_OSCTRIM		0
+#endif
+
+// Clock Timer1 (the tick) from the 64MHz PLL instead of the system clock (timing.h)
+#ifndef OPT_TIMER1_PLL
+#define OPT_TIMER1_PLL	0
+#endif
+
+// Fractional tick compare, continuously checked against Timer0 (tickcal.c)
+#ifndef OPT_TICKCAL
+#define OPT_TICKCAL		1
+#endif
+
+// Second resistor ladder on PB3, sampled alongside the first (adc.c).  Needs a profile with LADDER2_BUTTONS.
+#ifndef OPT_LADDER2
+#define OPT_LADDER2		0
+#endif
+
+// Extra push buttons to ground on PB1-PB3, debounced together (debounce.c).  A mask of PORTB pins, e.g. 0x04
+// for one button on PB2; each pin is a state of its own, VAL_DIG1 (PB1) .. VAL_DIG3 (PB3).
+#ifndef OPT_DIGITAL
+#define OPT_DIGITAL		0
+#endif
+#if OPT_DIGITAL & ~0x0E
+#error "Digital buttons can only be on PB1-PB3"
+#endif
+
+// Listen on the JVC line: wait for it to be idle before each frame, read back every released level and retry
+// a frame that collides with another device (jvc.c)
+#ifndef OPT_JVC_LISTEN
+#define OPT_JVC_LISTEN	1
+#endif
+
+// Quadrature rotary encoder for volume on two spare pins, read by the pin change interrupt (encoder.c)
+#ifndef OPT_ENCODER
+#define OPT_ENCODER		0
+#endif
+#ifndef ENCODER_PIN_A
+#define ENCODER_PIN_A	2
+#endif
+#ifndef ENCODER_PIN_B
+#define ENCODER_PIN_B	3
+#endif
+
+// Two buttons held together decode as chord states of their own (decode.c).  ~250 bytes of SRAM on the Astra.
+// Only chords clear of every other window are used: with the default +-TOLLERANCE (30) windows that is 1 of
+// the Astra's 15 (up + back), tighter learnt windows (OPT_CALIBRATE) free up more; tools/laddervec.c lists them.
+// The press of a button that is in a mapped chord is held back KEYMAP_CHORD_TICKS to see if a chord follows.
+#ifndef OPT_CHORDS
+#define OPT_CHORDS		0
+#endif
+
+// Debounce target follows the measured line noise, within DEBOUNCE_MIN_TICKS..DEBOUNCE_MAX_TICKS (debounce.c)
+#ifndef OPT_ADAPTIVE_DEBOUNCE
+#define OPT_ADAPTIVE_DEBOUNCE	0
+#endif
+
+// Watchdog reset after a hang, with the reset cause and what was running kept for the next start (watchdog.c)
+#ifndef OPT_WATCHDOG
+#define OPT_WATCHDOG	1
+#endif
+
+// Stack high-water mark: free SRAM painted at reset and checked for the deepest the stack reaches (stackmon.c)
+#ifndef OPT_STACKMON
+#define OPT_STACKMON	0
+#endif
+
+// Steering wheel ladder profile (ladder.h, vehicles/)
+#define VEHICLE_ASTRA	1
+#ifndef VEHICLE
+#define VEHICLE			VEHICLE_ASTRA
+#endif
+
+// Head unit output profile (headunit.h, headunits/)
+#define HEADUNIT_KDX351BT	1
+#define HEADUNIT_JVC		2
+#ifndef HEADUNIT
+#define HEADUNIT			HEADUNIT_KDX351BT
+#endif
+
+// Timer0 free runs in normal mode at F_CPU / TIMER0_PRESCALE for whichever of the above use it.
+// Telemetry baud rate is one bit per Timer0 wrap: 8MHz / 8 / 256 = 3906.25
+#define TIMER0_PRESCALE	8
+#define TIMER0_CS		(_BV(CS01))
+
+// PORTB pin usage.  Each option claims its pins here so two options can't be built onto the same pin.
+#define PINS_JVC		(1 << 0)
+#define PINS_LADDER		(1 << 4)
+#if OPT_LADDER2
+#define PINS_LADDER2	(1 << 3)	// ADC3
+#else
+#define PINS_LADDER2	0
+#endif
+#if OPT_TELEMETRY
+#define PINS_TELEMETRY	(1 << 1)	// USI DO, fixed in hardware
+#else
+#define PINS_TELEMETRY	0
+#endif
+
+#define PINS_DIGITAL	OPT_DIGITAL
+#if OPT_ENCODER
+#define PINS_ENCODER	((1 << ENCODER_PIN_A) | (1 << ENCODER_PIN_B))
+#else
+#define PINS_ENCODER	0
+#endif
+
+#define PINS_ALL_SUM	(PINS_JVC + PINS_LADDER + PINS_LADDER2 + PINS_TELEMETRY + PINS_DIGITAL + PINS_ENCODER)
+#define PINS_ALL_OR		(PINS_JVC | PINS_LADDER | PINS_LADDER2 | PINS_TELEMETRY | PINS_DIGITAL | PINS_ENCODER)
+#if PINS_ALL_SUM != PINS_ALL_OR
+#error "Two build options are configured onto the same PORTB pin"
+#endif
+#if PINS_ALL_OR & (1 << 5)
+#error "PB5 is RESET"
+#endif
+
+#endif
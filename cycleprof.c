@@ -0,0 +1,93 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "cycleprof.h"
+
+#if OPT_CYCLEPROF
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "bitmacros.h"
+
+volatile profStats_t profStats[PROF_STAGES];
+volatile uint16_t profMissedTicks;
+
+static volatile uint16_t profOverflows;
+static uint32_t profStart[PROF_STAGES];
+
+// Fires every 256 counts (256us at 8MHz), roughly 1% of the CPU
+ISR(TIMER0_OVF_vect)
+{
+	profOverflows++;
+}
+
+void profInit(void)
+{
+	// Normal mode, F_CPU/TIMER0_PRESCALE - same setup as telemetry so either can start it
+	TCCR0A = 0;
+	TCCR0B = TIMER0_CS;
+	_setBit(TIMSK, TOIE0);
+
+	profReset();
+}
+
+void profReset(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	for (uint8_t i = 0; i < PROF_STAGES; i++) {
+		profStats[i].min = 0xFFFFFFFFUL;
+		profStats[i].max = 0;
+		profStats[i].sum = 0;
+		profStats[i].count = 0;
+	}
+	profMissedTicks = 0;
+	SREG = sreg;
+}
+
+uint32_t profNow(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t hi;
+	uint8_t lo;
+
+	cli();
+	hi = profOverflows;
+	lo = TCNT0;
+	// an overflow that has happened but not been serviced yet (we may be in an ISR, or just masked it)
+	if ((TIFR & _BV(TOV0)) && lo < 0x80) {
+		hi++;
+	}
+	SREG = sreg;
+
+	return (((uint32_t)hi << 8) | lo) & 0x00FFFFFFUL;
+}
+
+void profBegin(uint8_t stage)
+{
+	profStart[stage] = profNow();
+}
+
+void profEnd(uint8_t stage)
+{
+	uint32_t elapsed = (profNow() - profStart[stage]) & 0x00FFFFFFUL;
+	volatile profStats_t *s = &profStats[stage];
+	uint8_t sreg = SREG;
+
+	cli();
+	if (elapsed < s->min) s->min = elapsed;
+	if (elapsed > s->max) s->max = elapsed;
+	if (s->count == 0xFFFF || s->sum > 0xFFFFFFFFUL - elapsed) {
+		// keep the mean meaningful rather than wrapping
+		s->sum >>= 1;
+		s->count >>= 1;
+	}
+	s->sum += elapsed;
+	s->count++;
+	SREG = sreg;
+}
+
+#endif
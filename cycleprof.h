@@ -0,0 +1,74 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Cycle budget profiler.
+
+Timer0 free runs at F_CPU/TIMER0_PRESCALE (8) and its overflow interrupt extends it to 24 bits, so a timestamp is one count
+per 8 CPU cycles (1us at 8MHz) and wraps after ~16s at 8MHz.  Each stage keeps min/max/sum/count in SRAM in
+timer counts; multiply by PROF_CYCLES_PER_COUNT for cycles.  Mean = sum / count.
+
+The figures are wall clock, so a main loop stage that is interrupted by the tick ISR includes the ISR time.
+That is deliberate - it is what counts against the 527us tick.
+
+Reading the stats:
+- simulator: the profStats[] array and profMissedTicks are plain globals, read them by symbol (e.g. simavr + gdb)
+- on target: dumped over the debug channel when one is built in
+
+With OPT_CYCLEPROF=0 the macros compile to nothing and none of this is linked.
+*/
+
+#ifndef CYCLEPROF_H
+#define CYCLEPROF_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define PROF_CYCLES_PER_COUNT	TIMER0_PRESCALE
+
+// Stages that are timed
+enum {
+	PROF_ISR,		// TIMER1_COMPA_vect body
+	PROF_ADC,		// ADC_vect body (one per conversion)
+	PROF_DECODE,	// DecodeAnalogue() inside ADC_vect
+	PROF_DEBOUNCE,	// getDebounced() from main()
+	PROF_DISPATCH,	// keymap and queueing commands for the transmitter
+	PROF_LOOP,		// whole main loop pass for one tick
+	PROF_STAGES
+};
+
+struct prof_stats {
+	uint32_t min;	// timer counts
+	uint32_t max;	// timer counts
+	uint32_t sum;	// timer counts, halved along with count before either would overflow
+	uint16_t count;
+};
+typedef struct prof_stats profStats_t;
+
+#if OPT_CYCLEPROF
+
+extern volatile profStats_t profStats[PROF_STAGES];
+extern volatile uint16_t profMissedTicks;	// ticks raised while the previous one was still unprocessed
+
+void profInit(void);
+void profReset(void);
+uint32_t profNow(void);
+void profBegin(uint8_t stage);
+void profEnd(uint8_t stage);
+
+#define PROF_BEGIN(stage)	profBegin(stage)
+#define PROF_END(stage)		profEnd(stage)
+#define PROF_MISSED_TICK()	(profMissedTicks++)
+
+#else
+
+#define PROF_BEGIN(stage)
+#define PROF_END(stage)
+#define PROF_MISSED_TICK()
+
+#endif
+
+#endif
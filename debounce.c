@@ -15,6 +15,9 @@ void initDebounce(debounceData *data, unsigned long ms, char idleState, char one
 	data->inactiveState = idleState;
 	data->oneShot = oneShot;
 	data->state = DEBOUNCE_INACTIVE;
+#if OPT_ADAPTIVE_DEBOUNCE
+	data->rejected = 0;
+#endif
 }
 
 extern volatile unsigned char tick;
@@ -41,6 +44,11 @@ char getDebounced(debounceData *data, char value) {
 			}
 			else {
 				data->state = DEBOUNCE_INACTIVE;
+#if OPT_ADAPTIVE_DEBOUNCE
+				if (data->rejected != 0xFF) {
+					data->rejected++;
+				}
+#endif
 			}
 			return data->inactiveState;
 
@@ -61,3 +69,88 @@ char getDebounced(debounceData *data, char value) {
 	}
 	return data->inactiveState;
 }
+
+// Call once per tick with the raw inputs; returns the debounced ones
+unsigned char updateDebouncedBits(debounceBits *data, unsigned char sample)
+{
+	unsigned char delta = sample ^ data->state;	// inputs that disagree with their debounced state
+
+	// count up where they disagree, reset where they don't
+	data->cnt1 = (data->cnt1 ^ data->cnt0) & delta;
+	data->cnt0 = ~data->cnt0 & delta;
+
+	// flip the ones whose counter has just wrapped round to 0
+	data->state ^= delta & ~(data->cnt0 | data->cnt1);
+	return data->state;
+}
+
+#if OPT_ADAPTIVE_DEBOUNCE
+void initDebounceNoise(debounceNoise *noise)
+{
+	noise->last = 0;
+	noise->spread = (DEBOUNCE_SPREAD_QUIET + DEBOUNCE_SPREAD_NOISY) / 2;
+	noise->ticks = 0;
+	noise->lastIdle = 0;
+	noise->quiet = 0;
+	noise->settle = 0;
+	noise->sinceActive = 0xFF;
+	noise->glitches = 0;
+}
+
+// Call once per tick, after getDebounced() for the same ladder
+void debounceAdapt(debounceData *data, debounceNoise *noise, uint16_t reading, char value)
+{
+	uint8_t idle = value == data->inactiveState;
+
+	if (idle && noise->lastIdle) {
+		uint16_t diff = reading > noise->last ? reading - noise->last : noise->last - reading;
+
+		// running mean over the last 16 or so, kept shifted up so small differences still count
+		if (diff <= DEBOUNCE_SPREAD_EDGE) {
+			noise->spread += diff - (noise->spread >> DEBOUNCE_SPREAD_SHIFT);
+		}
+	}
+	noise->last = reading;
+	noise->lastIdle = idle;
+
+	if (data->state == DEBOUNCE_ACTIVE) {
+		// any rejects just before were the press bouncing on its way in
+		noise->sinceActive = 0;
+		noise->settle = 0;
+		data->rejected = 0;
+	} else if (noise->sinceActive != 0xFF) {
+		noise->sinceActive++;
+	}
+	if (data->rejected && ++noise->settle >= DEBOUNCE_SETTLE_TICKS) {
+		// nothing came of them; unless it was a release bouncing they were glitches
+		if (noise->sinceActive >= 2 * DEBOUNCE_SETTLE_TICKS && noise->glitches < 0xFF - data->rejected) {
+			noise->glitches += data->rejected;
+		}
+		noise->settle = 0;
+		data->rejected = 0;
+	}
+
+	if (++noise->ticks < DEBOUNCE_ADAPT_TICKS) {
+		return;
+	}
+	noise->ticks = 0;
+
+	if (noise->spread > DEBOUNCE_SPREAD_NOISY || noise->glitches >= DEBOUNCE_REJECTS_NOISY) {
+		data->debounceTarget += DEBOUNCE_ADAPT_UP;
+		if (data->debounceTarget > DEBOUNCE_MAX_TICKS) {
+			data->debounceTarget = DEBOUNCE_MAX_TICKS;
+		}
+		noise->quiet = 0;
+	} else if (noise->spread < DEBOUNCE_SPREAD_QUIET && noise->glitches == 0) {
+		if (++noise->quiet >= DEBOUNCE_ADAPT_QUIET_PERIODS) {
+			if (data->debounceTarget > DEBOUNCE_MIN_TICKS) {
+				data->debounceTarget--;
+			}
+			noise->quiet = 0;
+		}
+	} else {
+		noise->quiet = 0;
+	}
+	noise->glitches = 0;
+}
+#endif
@@ -4,6 +4,15 @@ GPL v3
 Not licensed for commercial use
 */
 
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Ticks a ladder state has to be stable for before it is reported (the starting point with OPT_ADAPTIVE_DEBOUNCE)
+#define DEBOUNCE_TICKS	5
+
 // Debounce Data
 struct debounce_data {
 	char state; // state machine state
@@ -11,8 +20,67 @@ struct debounce_data {
 	unsigned long debounceTarget; // taregt to reach for state transition
 	char inactiveState; // the line is not active when it is in this state
 	char oneShot; // should we only return positive once, (i.e. on the state transition)
+#if OPT_ADAPTIVE_DEBOUNCE
+	unsigned char rejected; // presses that went back to inactive before the target, saturates at 255
+#endif
 };
 typedef struct debounce_data debounceData;
 
 char getDebounced(debounceData *data, char value);
 void initDebounce(debounceData *data, unsigned long ms, char idleState, char oneShot);
+
+#if OPT_ADAPTIVE_DEBOUNCE
+/*
+Adaptive debounce target.  debounceAdapt() is called once per tick with the ladder's raw reading and decoded
+state, and tracks how noisy the line is two ways: the mean difference between successive idle readings
+(the ATtiny has no multiplier, so this stands in for the variance), and how many presses getDebounced()
+threw away for going back to idle before the target.  A reject followed by an accepted press within
+DEBOUNCE_SETTLE_TICKS, or within that long of a release, is contact bounce and doesn't count; the rest are
+glitches on an otherwise idle line.  Every DEBOUNCE_ADAPT_TICKS it moves the target:
+	noisy (spread or rejects over the limit)	up DEBOUNCE_ADAPT_UP ticks at once
+	quiet for DEBOUNCE_ADAPT_QUIET_PERIODS		down one tick
+	otherwise									left alone
+always within DEBOUNCE_MIN_TICKS..DEBOUNCE_MAX_TICKS, so it backs off quickly and creeps in slowly.
+*/
+#define DEBOUNCE_MIN_TICKS				2
+#define DEBOUNCE_MAX_TICKS				12
+#define DEBOUNCE_ADAPT_TICKS			1024	// ~0.5s
+#define DEBOUNCE_ADAPT_UP				2
+#define DEBOUNCE_ADAPT_QUIET_PERIODS	4
+#define DEBOUNCE_SPREAD_SHIFT			4		// spread is the mean successive difference << this
+#define DEBOUNCE_SPREAD_QUIET			(2 << DEBOUNCE_SPREAD_SHIFT)		// under 2 counts
+#define DEBOUNCE_SPREAD_NOISY			(8 << DEBOUNCE_SPREAD_SHIFT)		// over 8 counts, a quarter of TOLLERANCE
+#define DEBOUNCE_SPREAD_EDGE			32		// bigger steps are edges, not noise, and aren't counted
+#define DEBOUNCE_REJECTS_NOISY			2		// glitches per period
+#define DEBOUNCE_SETTLE_TICKS			20		// ~10ms
+
+struct debounce_noise {
+	uint16_t last; // previous reading, if it was idle
+	uint16_t spread; // running mean of |reading - last| between idle readings, << DEBOUNCE_SPREAD_SHIFT
+	uint16_t ticks; // ticks into the current period
+	uint8_t lastIdle; // last reading decoded as idle
+	uint8_t quiet; // quiet periods in a row
+	uint8_t settle; // ticks since the oldest reject not yet put down to bounce or a glitch
+	uint8_t sinceActive; // ticks since a press was last reported, saturates at 255
+	uint8_t glitches; // this period
+};
+typedef struct debounce_noise debounceNoise;
+
+void initDebounceNoise(debounceNoise *noise);
+void debounceAdapt(debounceData *data, debounceNoise *noise, uint16_t reading, char value);
+#endif
+
+// Up to 8 on/off inputs debounced together, one bit each: a two bit counter per input kept "vertically"
+// across cnt0/cnt1, so an input changes state after 4 updates in a row that disagree with it
+struct debounce_bits {
+	unsigned char state; // debounced inputs, 1 = active
+	unsigned char cnt0; // counter bit 0 for each input
+	unsigned char cnt1; // counter bit 1 for each input
+};
+typedef struct debounce_bits debounceBits;
+
+#define DEBOUNCE_BITS_SAMPLES	4
+
+unsigned char updateDebouncedBits(debounceBits *data, unsigned char sample);
+
+#endif
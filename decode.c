@@ -0,0 +1,243 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "decode.h"
+
+decodeWindow decodeTable[DECODE_BUTTONS];
+
+static const uint16_t decodeDefaults[DECODE_BUTTONS] = {
+	LADDER_BUTTONS(LADDER_CENTRE)
+};
+
+static const uint8_t decodeStates[DECODE_BUTTONS] = {
+	LADDER_BUTTONS(LADDER_STATE)
+};
+
+#if OPT_LADDER2
+decodeWindow decodeTable2[DECODE_BUTTONS2];
+
+static const uint16_t decodeDefaults2[DECODE_BUTTONS2] = {
+	LADDER2_BUTTONS(LADDER2_CENTRE)
+};
+
+static const uint8_t decodeStates2[DECODE_BUTTONS2] = {
+	LADDER2_BUTTONS(LADDER_STATE)
+};
+#endif
+
+#if OPT_CHORDS
+decodeWindow decodeChords[DECODE_CHORDS];
+uint8_t decodeChordCount;
+
+// Every window, ascending: index < DECODE_BUTTONS is decodeTable[index], the rest decodeChords[]
+static uint8_t decodeSorted[DECODE_BUTTONS + DECODE_CHORDS];
+static uint8_t decodeSortedCount;
+static uint8_t decodeBucket[DECODE_BUCKETS];
+#endif
+
+static void setWindow(decodeWindow *w, uint16_t centre, uint16_t tollerance)
+{
+	if (centre <= tollerance) {
+		w->lower = 0;
+	} else {
+		w->lower = centre - tollerance;
+	}
+	w->upper = centre + tollerance;
+}
+
+#if !OPT_CHORDS || OPT_LADDER2
+static uint8_t decodeWindows(const decodeWindow *table, uint8_t count, uint16_t adcVal)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		if (adcVal >= table[i].lower && adcVal <= table[i].upper) {
+			return table[i].state;
+		}
+	}
+	return VAL_IDLE;
+}
+#endif
+
+void decodeInit(void)
+{
+	for (uint8_t i = 0; i < DECODE_BUTTONS; i++) {
+		decodeTable[i].state = decodeStates[i];
+		decodeSetWindow(i, decodeDefaults[i], TOLLERANCE);
+	}
+#if OPT_LADDER2
+	for (uint8_t i = 0; i < DECODE_BUTTONS2; i++) {
+		decodeTable2[i].state = decodeStates2[i];
+		setWindow(&decodeTable2[i], decodeDefaults2[i], TOLLERANCE);
+	}
+#endif
+	decodeBuild();
+}
+
+uint16_t decodeDefaultCentre(uint8_t index)
+{
+	return decodeDefaults[index];
+}
+
+void decodeSetWindow(uint8_t index, uint16_t centre, uint16_t tollerance)
+{
+	setWindow(&decodeTable[index], centre, tollerance);
+}
+
+#if OPT_CHORDS
+uint8_t decodeChordState(uint8_t first, uint8_t second)
+{
+	return VAL_CHORD + first * (2 * DECODE_BUTTONS - first - 1) / 2 + (second - first - 1);
+}
+
+// Non-zero if chord state chord is a pair with the button that decodes as state in it
+uint8_t decodeChordHas(uint8_t chord, uint8_t state)
+{
+	uint8_t n = chord - VAL_CHORD, first = 0;
+
+	// rows of the pair triangle get one shorter each time, see decodeChordState()
+	while (n >= DECODE_BUTTONS - 1 - first) {
+		n -= DECODE_BUTTONS - 1 - first;
+		first++;
+	}
+	return decodeTable[first].state == state || decodeTable[first + 1 + n].state == state;
+}
+
+// ADC reading to (1024 - adc) / adc in 16.16, which is proportional to the conductance of the ladder
+static uint32_t conductance(uint16_t adc)
+{
+	if (adc == 0) {
+		adc = 1;
+	}
+	return ((uint32_t)(1024 - adc) << 16) / adc;
+}
+
+static uint16_t halfWidthOf(const decodeWindow *w)
+{
+	return (w->upper - w->lower) / 2;
+}
+
+static uint8_t overlaps(const decodeWindow *a, const decodeWindow *b)
+{
+	return a->lower <= b->upper && b->lower <= a->upper;
+}
+
+static const decodeWindow *sortedWindow(uint8_t pos)
+{
+	uint8_t index = decodeSorted[pos];
+
+	if (index < DECODE_BUTTONS) {
+		return &decodeTable[index];
+	}
+	return &decodeChords[index - DECODE_BUTTONS];
+}
+
+static void buildChords(void)
+{
+	decodeWindow idle;
+	uint32_t idleG = conductance(LADDER_IDLE_ADC);
+	uint8_t n = 0;
+
+	setWindow(&idle, LADDER_IDLE_ADC, TOLLERANCE);
+
+	// every pair, from the centres of the current windows
+	for (uint8_t i = 0; i < DECODE_BUTTONS; i++) {
+		for (uint8_t j = i + 1; j < DECODE_BUTTONS; j++) {
+			const decodeWindow *a = &decodeTable[i], *b = &decodeTable[j];
+			uint32_t g = conductance((a->lower + a->upper + 1) / 2) + conductance((b->lower + b->upper + 1) / 2) - idleG;
+			uint16_t centre = ((1024UL << 16) + (((1UL << 16) + g) / 2)) / ((1UL << 16) + g);
+			uint16_t tol = halfWidthOf(a) < halfWidthOf(b) ? halfWidthOf(a) : halfWidthOf(b);
+
+			setWindow(&decodeChords[n], centre, tol);
+			decodeChords[n].state = decodeChordState(i, j);
+			n++;
+		}
+	}
+
+	// mark the ones that could be mistaken for something else (or each other) as idle...
+	for (uint8_t c = 0; c < DECODE_CHORDS; c++) {
+		uint8_t clear = !overlaps(&decodeChords[c], &idle);
+
+		for (uint8_t i = 0; clear && i < DECODE_BUTTONS; i++) {
+			clear = !overlaps(&decodeChords[c], &decodeTable[i]);
+		}
+		for (uint8_t k = 0; clear && k < DECODE_CHORDS; k++) {
+			clear = k == c || !overlaps(&decodeChords[c], &decodeChords[k]);
+		}
+		if (!clear) {
+			decodeChords[c].state = VAL_IDLE;
+		}
+	}
+
+	// ...and keep the rest
+	decodeChordCount = 0;
+	for (uint8_t c = 0; c < DECODE_CHORDS; c++) {
+		if (decodeChords[c].state != VAL_IDLE) {
+			decodeChords[decodeChordCount++] = decodeChords[c];
+		}
+	}
+}
+
+void decodeBuild(void)
+{
+	uint8_t pos = 0;
+
+	buildChords();
+
+	// insertion sort every window by lower edge
+	decodeSortedCount = DECODE_BUTTONS + decodeChordCount;
+	for (uint8_t i = 0; i < decodeSortedCount; i++) {
+		uint8_t j = i;
+		decodeSorted[j] = i;
+		while (j > 0 && sortedWindow(j - 1)->lower > sortedWindow(j)->lower) {
+			uint8_t t = decodeSorted[j];
+			decodeSorted[j] = decodeSorted[j - 1];
+			decodeSorted[j - 1] = t;
+			j--;
+		}
+	}
+
+	// first window in each bucket, i.e. the first one that ends at or after the bucket starts
+	for (uint8_t b = 0; b < DECODE_BUCKETS; b++) {
+		while (pos < decodeSortedCount && sortedWindow(pos)->upper < ((uint16_t)b << DECODE_BUCKET_SHIFT)) {
+			pos++;
+		}
+		decodeBucket[b] = pos;
+	}
+}
+
+// Windows don't overlap, so sorted by lower edge they are sorted by upper edge too
+uint8_t DecodeAnalogue(uint16_t adcVal)
+{
+	if (adcVal > 1023) {
+		adcVal = 1023;
+	}
+	for (uint8_t pos = decodeBucket[adcVal >> DECODE_BUCKET_SHIFT]; pos < decodeSortedCount; pos++) {
+		const decodeWindow *w = sortedWindow(pos);
+		if (adcVal < w->lower) {
+			break;
+		}
+		if (adcVal <= w->upper) {
+			return w->state;
+		}
+	}
+	return VAL_IDLE;
+}
+#else
+void decodeBuild(void)
+{
+}
+
+uint8_t DecodeAnalogue(uint16_t adcVal)
+{
+	return decodeWindows(decodeTable, DECODE_BUTTONS, adcVal);
+}
+#endif
+
+#if OPT_LADDER2
+uint8_t DecodeAnalogue2(uint16_t adcVal)
+{
+	return decodeWindows(decodeTable2, DECODE_BUTTONS2, adcVal);
+}
+#endif
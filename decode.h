@@ -0,0 +1,96 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+ADC value to button state decoding.
+The default windows are generated from the vehicle's ladder profile (ladder.h) at compile time.
+They live in SRAM so they can be replaced by per-install calibration (calibrate.c) at boot.
+The host tools (tools/laddervec.c and the rest) link this file as it is.
+*/
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+
+// States
+// VAL_AUXn are buttons on a second ladder (OPT_LADDER2) and VAL_DIGn the digital buttons on PB1-PB3
+// (OPT_DIGITAL); what they do is up to the keymap.
+// With OPT_CHORDS, two buttons held together decode to VAL_CHORD + n, see decodeChordState().
+enum {VAL_IDLE, VAL_VOLUP, VAL_VOLDN, VAL_SRC, VAL_SEEKFWD, VAL_SEEKBK, VAL_SOUND,
+	VAL_AUX1, VAL_AUX2, VAL_AUX3, VAL_AUX4, VAL_DIG1, VAL_DIG2, VAL_DIG3, VAL_CHORD};
+
+// Calcs for ADC thresholds for handling values
+// Vref = 5v
+// 10 bits = 1024
+// 1 bit = ~0.005V
+// +-0.1V = 15
+#define TOLLERANCE	30
+
+// Voltage values for the selected vehicle, assuming vref = 5v
+#include "ladder.h"
+
+// Number of buttons on the ladder (not counting idle)
+#define DECODE_BUTTONS	LADDER_COUNT
+
+#if OPT_CHORDS
+#define DECODE_CHORDS	(DECODE_BUTTONS * (DECODE_BUTTONS - 1) / 2)
+#else
+#define DECODE_CHORDS	0
+#endif
+
+#define VAL_STATES		(VAL_CHORD + DECODE_CHORDS)
+
+struct decode_window {
+	uint16_t lower;
+	uint16_t upper;
+	uint8_t state;
+};
+typedef struct decode_window decodeWindow;
+
+// In ladder profile order, highest to lowest ADC value, which is also the order buttons are learnt in
+extern decodeWindow decodeTable[DECODE_BUTTONS];
+
+#if OPT_CHORDS
+/*
+Chords.  Buttons on the ladder switch their resistor in parallel with the idle resistance, so holding
+buttons i and j reads as 1/R = 1/Ri + 1/Rj - 1/Ridle.  decodeBuild() works that out for every pair from the
+current single button windows, and keeps the chords whose window (as tight as the tighter of the two
+buttons) is clear of idle, every button and every other chord.  Chord n is the nth pair (i, j), i < j, in
+decodeTable order: 0 = (0,1), 1 = (0,2) .. so on the Astra VAL_CHORD + 0 is up + back.
+
+With every window in one sorted list, decodeBucket[] holds for each 32 count slice of the ADC range the
+first window that can contain a reading in it, so a lookup checks at most a couple of windows however many
+chords there are.
+*/
+#define DECODE_BUCKET_SHIFT	5
+#define DECODE_BUCKETS		(1024 >> DECODE_BUCKET_SHIFT)
+
+extern decodeWindow decodeChords[DECODE_CHORDS];	// usable chords only, decodeChordCount of them
+extern uint8_t decodeChordCount;
+#endif
+
+#if OPT_LADDER2
+// Second ladder on its own pin; always uses the profile defaults
+#define DECODE_BUTTONS2	LADDER2_COUNT
+extern decodeWindow decodeTable2[DECODE_BUTTONS2];
+#endif
+
+void decodeInit(void);
+// After changing windows call decodeBuild() before decoding again
+void decodeSetWindow(uint8_t index, uint16_t centre, uint16_t tollerance);
+void decodeBuild(void);
+uint16_t decodeDefaultCentre(uint8_t index);
+uint8_t DecodeAnalogue(uint16_t adcVal);
+#if OPT_CHORDS
+uint8_t decodeChordState(uint8_t first, uint8_t second);
+uint8_t decodeChordHas(uint8_t chord, uint8_t state);
+#endif
+#if OPT_LADDER2
+uint8_t DecodeAnalogue2(uint16_t adcVal);
+#endif
+
+#endif
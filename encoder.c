@@ -0,0 +1,81 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "encoder.h"
+
+#if OPT_ENCODER
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "bitmacros.h"
+
+#define ENCODER_PINS	(_BV(ENCODER_PIN_A) | _BV(ENCODER_PIN_B))
+
+volatile int8_t encoderSteps;
+
+static uint8_t encoderLast;
+static int8_t encoderQuarters;
+
+// Indexed by old AB << 2 | new AB: +1 / -1 for a quarter step either way, 0 for no change or a skipped state
+static const int8_t encoderTable[16] = {
+	 0, -1,  1,  0,
+	 1,  0,  0, -1,
+	-1,  0,  0,  1,
+	 0,  1, -1,  0
+};
+
+static uint8_t readPins(void)
+{
+	uint8_t pins = PINB;
+	return ((pins >> ENCODER_PIN_A) & 1) << 1 | ((pins >> ENCODER_PIN_B) & 1);
+}
+
+ISR(PCINT0_vect)
+{
+	uint8_t now = readPins();
+
+	encoderQuarters += encoderTable[encoderLast << 2 | now];
+	encoderLast = now;
+
+	if (encoderQuarters >= ENCODER_QUARTERS) {
+		encoderQuarters -= ENCODER_QUARTERS;
+		if (encoderSteps < ENCODER_MAX_STEPS) {
+			encoderSteps++;
+		}
+	} else if (encoderQuarters <= -ENCODER_QUARTERS) {
+		encoderQuarters += ENCODER_QUARTERS;
+		if (encoderSteps > -ENCODER_MAX_STEPS) {
+			encoderSteps--;
+		}
+	}
+}
+
+void encoderInit(void)
+{
+	PORTB |= ENCODER_PINS;		// pull-ups
+	encoderLast = readPins();
+	PCMSK |= ENCODER_PINS;
+	_setBit(GIMSK, PCIE);
+}
+
+// One detent off the count: 1 for up, -1 for down, 0 if there are none waiting
+int8_t encoderTake(void)
+{
+	int8_t step = 0;
+	uint8_t sreg = SREG;
+
+	cli();
+	if (encoderSteps > 0) {
+		step = 1;
+	} else if (encoderSteps < 0) {
+		step = -1;
+	}
+	encoderSteps -= step;
+	SREG = sreg;
+	return step;
+}
+
+#endif
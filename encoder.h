@@ -0,0 +1,40 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Quadrature rotary encoder for volume.
+
+A and B go to ENCODER_PIN_A / ENCODER_PIN_B with the common to ground (internal pull-ups).  Every edge on
+either pin raises PCINT0, which looks up the old and new A/B pair in a state table, so each quarter step
+counts and a bounce just steps back and forth.  ENCODER_QUARTERS quarter steps make one detent, which is
+added to encoderSteps.  The interrupt runs through JVC sends too, so nothing is lost however fast the knob
+turns while a command is going out; only a turn fast enough for both pins to change between two interrupts
+(a few us) could miss a quarter step.
+
+main() moves detents from encoderSteps into the transmit queue as HU_VOLUP / HU_VOLDN one at a time, each
+once no press or other volume step is waiting, so they go out back to back as fast as the protocol goes but
+never fill the queue ahead of a button press.
+*/
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+#include "config.h"
+
+#if OPT_ENCODER
+
+#define ENCODER_QUARTERS	4		// quarter steps per detent
+#define ENCODER_MAX_STEPS	100		// detents kept waiting either way, beyond that the knob is just spinning
+
+extern volatile int8_t encoderSteps;	// detents not sent yet, + is clockwise (volume up)
+
+void encoderInit(void);
+int8_t encoderTake(void);
+
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Head unit output profile, chosen at build time with HEADUNIT (config.h).
+
+Each head unit is a header in headunits/ describing its wired remote protocol as constants:
+	HU_UNIT_NS						protocol unit, which the tick is set to (timing.h)
+	HU_RESET_UNITS .. HU_SPACE1_UNITS	header and bit timings in units
+	HU_START_BITS, HU_ADDRESS(_BITS), HU_COMMAND_BITS, HU_STOP_BITS, HU_LSB_FIRST	frame layout
+	HU_FRAMES						frames sent per command
+	HU_VOLUP .. HU_SEEKFWD			command codes for the keymap defaults
+	HU_xxx_HOLD						what the keymap sends while that button is held
+The transmitter (jvc.c) is built from these so it is the same table free loop whichever unit is chosen, and
+only the selected header is ever included so the others cost nothing.  To add one, copy
+headunits/kdx351bt.h, give it a HEADUNIT_xxx number in config.h and a line below.
+*/
+
+#ifndef HEADUNIT_H
+#define HEADUNIT_H
+
+#include "config.h"
+
+#if HEADUNIT == HEADUNIT_KDX351BT
+#include "headunits/kdx351bt.h"
+#elif HEADUNIT == HEADUNIT_JVC
+#include "headunits/jvc.h"
+#else
+#error "Unknown HEADUNIT"
+#endif
+
+#define HU_BITS		(HU_START_BITS + HU_ADDRESS_BITS + HU_COMMAND_BITS + HU_STOP_BITS)
+
+#if HU_BITS > 32 || HU_ADDRESS_BITS > 8 || HU_COMMAND_BITS > 8
+#error "Head unit frame doesn't fit the transmitter"
+#endif
+#if HU_RESET_UNITS < 1 || HU_LEAD_LOW_UNITS < 1 || HU_LEAD_HIGH_UNITS < 1 || HU_MARK_UNITS < 1 \
+	|| HU_SPACE0_UNITS < 1 || HU_SPACE1_UNITS < 1 || HU_FRAMES < 1
+#error "Every head unit timing has to be at least one unit"
+#endif
+
+#endif
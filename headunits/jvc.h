@@ -0,0 +1,42 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+JVC head units that take the dedicated hold codes for both seek directions (0x13 back, 0x14 fwd).
+Same protocol and command set as the KD-X351BT (headunits/kdx351bt.h).
+*/
+
+#define HU_NAME			"JVC (seek hold codes)"
+
+#define HU_UNIT_NS			527000UL
+#define HU_RESET_UNITS		1
+#define HU_LEAD_LOW_UNITS	16
+#define HU_LEAD_HIGH_UNITS	8
+#define HU_MARK_UNITS		1
+#define HU_SPACE0_UNITS		1
+#define HU_SPACE1_UNITS		3
+
+#define HU_START_BITS		1
+#define HU_ADDRESS			0x47
+#define HU_ADDRESS_BITS		7
+#define HU_COMMAND_BITS		7
+#define HU_STOP_BITS		2
+#define HU_LSB_FIRST		1
+#define HU_FRAMES			3
+
+#define HU_VOLUP		0x04
+#define HU_VOLDN		0x05
+#define HU_SOUND		0x0D
+#define HU_SRC			0x08
+#define HU_SEEKBK		0x11
+#define HU_SEEKFWD		0x12
+
+#define HU_VOLUP_HOLD	HU_VOLUP
+#define HU_VOLDN_HOLD	HU_VOLDN
+#define HU_SOUND_HOLD	KEY_NONE
+#define HU_SRC_HOLD		KEY_NONE
+#define HU_SEEKBK_HOLD	0x13
+#define HU_SEEKFWD_HOLD	0x14
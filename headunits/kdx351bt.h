@@ -0,0 +1,47 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+JVC KD-X351BT wired remote input.
+JVC pulse length protocol: one unit is 527us, every bit is a 1 unit mark then a 1 (0) or 3 (1) unit space,
+7 bit address 0x47 and 7 bit command, LSB first.  Each command is sent as 3 frames.
+*/
+
+#define HU_NAME			"JVC KD-X351BT"
+
+// Timings in protocol units; the tick is one unit
+#define HU_UNIT_NS			527000UL
+#define HU_RESET_UNITS		1		// line released before the header
+#define HU_LEAD_LOW_UNITS	16		// header AGC, line held low
+#define HU_LEAD_HIGH_UNITS	8		// header AGC, line released
+#define HU_MARK_UNITS		1		// low part of every bit
+#define HU_SPACE0_UNITS		1		// high part of a 0
+#define HU_SPACE1_UNITS		3		// high part of a 1
+
+// Framing
+#define HU_START_BITS		1		// 1s ahead of the address
+#define HU_ADDRESS			0x47
+#define HU_ADDRESS_BITS		7
+#define HU_COMMAND_BITS		7
+#define HU_STOP_BITS		2		// 1s after the command
+#define HU_LSB_FIRST		1
+#define HU_FRAMES			3		// frames per command
+
+// Commands
+#define HU_VOLUP		0x04
+#define HU_VOLDN		0x05
+#define HU_SOUND		0x0D
+#define HU_SRC			0x08
+#define HU_SEEKBK		0x11
+#define HU_SEEKFWD		0x12
+
+// What to send while a button is held, KEY_NONE for nothing
+#define HU_VOLUP_HOLD	HU_VOLUP
+#define HU_VOLDN_HOLD	HU_VOLDN
+#define HU_SOUND_HOLD	KEY_NONE
+#define HU_SRC_HOLD		KEY_NONE
+#define HU_SEEKBK_HOLD	0x13	// held back needs the alternate code
+#define HU_SEEKFWD_HOLD	HU_SEEKFWD	// held fwd needs the original code repeated
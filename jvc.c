@@ -0,0 +1,294 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "bitmacros.h"
+#include "bitNames.h"
+#include "jvc.h"
+#include "timing.h"
+#include "telemetry.h"
+
+// Frame: bus reset, AGC low, AGC high, then a mark and a space for each of the HU_BITS bits
+#define JVC_SEGMENTS	(3 + 2 * HU_BITS)
+
+struct jvc_entry {
+	uint8_t cmd;
+	uint8_t prio;
+	uint8_t held;	// state a JVC_PRIO_REPEAT belongs to
+};
+typedef struct jvc_entry jvcEntry;
+
+volatile uint16_t jvcDropped;
+#if OPT_JVC_LISTEN
+volatile uint16_t jvcCollisions;
+volatile uint16_t jvcAbandoned;
+#endif
+
+static jvcEntry jvcPending[JVC_QUEUE];
+static volatile uint8_t jvcCount;
+
+// Command on the wire; framesLeft counts the frames still to start after the current one
+static jvcEntry jvcCurrent;
+static volatile uint8_t jvcActive;
+static uint8_t jvcFramesLeft;
+static uint8_t jvcSegment;
+static uint8_t jvcCountdown;
+static uint32_t jvcBits;
+static uint8_t jvcWaiting;		// between frames, waiting for the line to be idle
+#if OPT_JVC_LISTEN
+static uint8_t jvcReleased = 1;	// our side of the line: 1 = let go, 0 = pulled low
+static uint8_t jvcIdle;			// ticks the line has been seen high, up to 255
+static uint8_t jvcRetries;
+#endif
+
+static void setLine(uint8_t level)
+{
+	_movNamedBitNoPullUp(JVC, level);
+#if OPT_JVC_LISTEN
+	jvcReleased = level;
+#endif
+}
+
+// Default class for a code: volume is what the driver notices being late
+uint8_t JVCPriority(uint8_t cmd)
+{
+	if (cmd == HU_VOLUP || cmd == HU_VOLDN) {
+		return JVC_PRIO_VOLUME;
+	}
+	return JVC_PRIO_PRESS;
+}
+
+static void removeAt(uint8_t i)
+{
+	jvcCount--;
+	for (; i < jvcCount; i++) {
+		jvcPending[i] = jvcPending[i + 1];
+	}
+}
+
+// Returns 0 if it was turned away: the queue is full and there is no hold repeat in it to make room
+uint8_t JVCQueue(uint8_t cmd, uint8_t prio, uint8_t held)
+{
+	uint8_t sreg = SREG;
+	uint8_t accepted = 1;
+
+	cli();
+	if (jvcCount == JVC_QUEUE) {
+		// only a hold repeat makes room, the oldest; a press or volume step is never dropped for another,
+		// the caller keeps the one turned away and offers it again
+		uint8_t victim = 0;
+		while (victim < jvcCount && jvcPending[victim].prio != JVC_PRIO_REPEAT) {
+			victim++;
+		}
+		if (victim < jvcCount && prio > JVC_PRIO_REPEAT) {
+			removeAt(victim);
+		} else {
+			accepted = 0;
+		}
+		jvcDropped++;
+	}
+	if (accepted) {
+		jvcPending[jvcCount].cmd = cmd;
+		jvcPending[jvcCount].prio = prio;
+		jvcPending[jvcCount].held = held;
+		jvcCount++;
+	}
+	SREG = sreg;
+	return accepted;
+}
+
+// Commands waiting (not yet started) of class prio or above
+uint8_t JVCWaiting(uint8_t prio)
+{
+	uint8_t sreg = SREG;
+	uint8_t n = 0;
+
+	cli();
+	for (uint8_t i = 0; i < jvcCount; i++) {
+		if (jvcPending[i].prio >= prio) {
+			n++;
+		}
+	}
+	SREG = sreg;
+	return n;
+}
+
+uint8_t JVCBusy(void)
+{
+	return jvcActive || jvcCount;
+}
+
+static uint8_t higherWaiting(uint8_t prio)
+{
+	for (uint8_t i = 0; i < jvcCount; i++) {
+		if (jvcPending[i].prio > prio) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Hold repeats whose button has been let go (or changed) are not worth sending
+static void dropObsolete(uint8_t state)
+{
+	for (uint8_t i = 0; i < jvcCount; ) {
+		if (jvcPending[i].prio == JVC_PRIO_REPEAT && jvcPending[i].held != state) {
+			removeAt(i);
+		} else {
+			i++;
+		}
+	}
+}
+
+static uint8_t takeNext(void)
+{
+	uint8_t best = 0;
+
+	if (jvcCount == 0) {
+		return 0;
+	}
+	for (uint8_t i = 1; i < jvcCount; i++) {
+		if (jvcPending[i].prio > jvcPending[best].prio) {
+			best = i;
+		}
+	}
+	jvcCurrent = jvcPending[best];
+	removeAt(best);
+	jvcFramesLeft = HU_FRAMES;
+#if OPT_JVC_LISTEN
+	jvcRetries = 0;
+#endif
+	TLM_COMMAND(jvcCurrent.cmd, jvcCount);
+	return 1;
+}
+
+#if !HU_LSB_FIRST
+static uint8_t reverse(uint8_t v, uint8_t bits)
+{
+	uint8_t r = 0;
+
+	for (uint8_t i = 0; i < bits; i++) {
+		r = (r << 1) | (v & 1);
+		v >>= 1;
+	}
+	return r;
+}
+#define FIELD(v, bits)	reverse((v), (bits))
+#else
+#define FIELD(v, bits)	((v) & ((1U << (bits)) - 1))
+#endif
+
+// All the frame's bits in the order they go out, first in bit 0
+static void startFrame(void)
+{
+	jvcBits = ((1UL << HU_START_BITS) - 1)
+		| (uint32_t)FIELD(HU_ADDRESS, HU_ADDRESS_BITS) << HU_START_BITS
+		| (uint32_t)FIELD(jvcCurrent.cmd, HU_COMMAND_BITS) << (HU_START_BITS + HU_ADDRESS_BITS)
+		| ((1UL << HU_STOP_BITS) - 1) << (HU_START_BITS + HU_ADDRESS_BITS + HU_COMMAND_BITS);
+	jvcSegment = 0;
+	jvcFramesLeft--;
+}
+
+// Line level and length of segment n of the frame
+static void startSegment(uint8_t n)
+{
+	uint8_t ticks;
+
+	if (n == 0) {
+		setLine(1);		// Bus reset
+		ticks = HU_RESET_TICKS;
+	} else if (n == 1) {
+		setLine(0);		// AGC
+		ticks = HU_LEAD_LOW_TICKS;
+	} else if (n == 2) {
+		setLine(1);		// AGC
+		ticks = HU_LEAD_HIGH_TICKS;
+	} else if (((n - 3) & 1) == 0) {
+		setLine(0);		// mark
+		ticks = HU_MARK_TICKS;
+	} else {
+		setLine(1);		// space, long for a 1
+		ticks = (jvcBits >> ((n - 3) >> 1)) & 1 ? HU_SPACE1_TICKS : HU_SPACE0_TICKS;
+	}
+	jvcCountdown = ticks - 1;
+}
+
+#if OPT_JVC_LISTEN
+// Someone else has the line: let go and send the whole frame again once it is idle
+static void collision(void)
+{
+	setLine(1);
+	jvcCollisions++;
+	if (++jvcRetries > JVC_RETRIES) {
+		jvcAbandoned++;
+		jvcActive = 0;
+	} else {
+		jvcFramesLeft++;
+		jvcWaiting = 1;
+	}
+}
+#endif
+
+// Call from the tick ISR with the current debounced state
+void JVCTick(uint8_t state)
+{
+#if OPT_JVC_LISTEN
+	uint8_t line = _getNamedBit(JVC);
+
+	if (jvcReleased && line) {
+		if (jvcIdle < 255) {
+			jvcIdle++;
+		}
+	} else {
+		jvcIdle = 0;
+	}
+	if (jvcActive && !jvcWaiting && jvcReleased && !line) {
+		collision();
+		return;
+	}
+#endif
+
+	if (jvcActive && !jvcWaiting) {
+		if (jvcCountdown) {
+			jvcCountdown--;
+			return;
+		}
+		if (++jvcSegment < JVC_SEGMENTS) {
+			startSegment(jvcSegment);
+			return;
+		}
+
+		// frame boundary
+		if (jvcFramesLeft && jvcCurrent.prio == JVC_PRIO_REPEAT
+			&& (jvcCurrent.held != state || higherWaiting(JVC_PRIO_REPEAT))) {
+			jvcFramesLeft = 0;
+		}
+		if (jvcFramesLeft) {
+			jvcWaiting = 1;
+		} else {
+			jvcActive = 0;
+		}
+	}
+
+	if (!jvcActive) {
+		dropObsolete(state);
+		if (!takeNext()) {
+			return;
+		}
+		jvcActive = 1;
+		jvcWaiting = 1;
+	}
+
+#if OPT_JVC_LISTEN
+	if (jvcIdle < JVC_IDLE_TICKS) {
+		return;
+	}
+#endif
+	jvcWaiting = 0;
+	startFrame();
+	startSegment(0);
+}
@@ -0,0 +1,52 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+JVC style (pulse length) wired remote transmitter.  The protocol details - timings, address, frame layout,
+frames per command and command codes - come from the head unit profile selected in headunit.h.
+
+Commands are queued and sent from the tick ISR, one protocol unit per tick, so main() keeps running (and
+queueing) while the line is busy.  Each queued command carries a priority class; whenever the line is free
+the highest class waiting goes next, oldest first within a class.  A hold repeat (JVC_PRIO_REPEAT) is tied
+to the button state that produced it: it is dropped from the queue if that state has gone by the time it
+would be sent, and a burst already on the wire stops at the next frame boundary when the button is let go
+or something more important is waiting.  Presses always send all HU_FRAMES frames.  With the queue full a
+new command only pushes out a hold repeat; otherwise it is turned away, and main() offers it again.
+
+With OPT_JVC_LISTEN the line is also read back every tick (it is open drain, pulled up by the head unit).
+A frame only starts once the line has been high for JVC_IDLE_TICKS, and if it reads low while we have it
+released someone else is driving it: the frame is abandoned and sent again from the start once the line is
+idle, up to JVC_RETRIES times per command.
+*/
+
+#ifndef JVC_H
+#define JVC_H
+
+#include <stdint.h>
+#include "config.h"
+#include "headunit.h"
+
+#define JVC_QUEUE	4		// commands waiting for the line
+
+#define JVC_IDLE_TICKS	3	// line high this long before a frame starts (a frame's own stop bit counts)
+#define JVC_RETRIES		3	// frames restarted after a collision before the command is given up
+
+// Priority classes, lowest first
+enum {JVC_PRIO_REPEAT, JVC_PRIO_PRESS, JVC_PRIO_VOLUME};
+
+extern volatile uint16_t jvcDropped;	// commands that found the queue full: hold repeats pushed out, or turned away
+#if OPT_JVC_LISTEN
+extern volatile uint16_t jvcCollisions;	// frames abandoned because someone else pulled the line low
+extern volatile uint16_t jvcAbandoned;	// commands given up after JVC_RETRIES collisions
+#endif
+
+uint8_t JVCPriority(uint8_t cmd);
+uint8_t JVCQueue(uint8_t cmd, uint8_t prio, uint8_t held);
+uint8_t JVCWaiting(uint8_t prio);
+uint8_t JVCBusy(void);
+void JVCTick(uint8_t state);
+
+#endif
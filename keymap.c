@@ -0,0 +1,139 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "keymap.h"
+#include "headunit.h"
+
+keymapEntry keymap[VAL_STATES] = {
+	[VAL_IDLE]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},
+	[VAL_VOLUP]		= {HU_VOLUP,	HU_VOLUP_HOLD,		400,	0,	400},
+	[VAL_VOLDN]		= {HU_VOLDN,	HU_VOLDN_HOLD,		400,	0,	400},
+	[VAL_SRC]		= {HU_SRC,		HU_SRC_HOLD,		0,		0,	0},
+	[VAL_SEEKFWD]	= {HU_SEEKFWD,	HU_SEEKFWD_HOLD,	KEYMAP_SEEK_REPEAT_TICKS,	0,	KEYMAP_SEEK_REPEAT_TICKS},
+	[VAL_SEEKBK]	= {HU_SEEKBK,	HU_SEEKBK_HOLD,		KEYMAP_SEEK_REPEAT_TICKS,	0,	KEYMAP_SEEK_REPEAT_TICKS},
+	[VAL_SOUND]		= {HU_SOUND,	HU_SOUND_HOLD,		0,		0,	0},
+	[VAL_AUX1]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},		// second ladder, unmapped until set in EEPROM
+	[VAL_AUX2]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},
+	[VAL_AUX3]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},
+	[VAL_AUX4]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},
+	[VAL_DIG1]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},		// digital buttons, unmapped until set in EEPROM
+	[VAL_DIG2]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},
+	[VAL_DIG3]		= {KEY_NONE,	KEY_NONE,		0,		0,	0},
+#if OPT_CHORDS
+	[VAL_CHORD ... VAL_STATES - 1] = {KEY_NONE, KEY_NONE, 0, 0, 0},	// chords, unmapped until set in EEPROM
+#endif
+};
+
+static uint8_t lastState = VAL_IDLE;
+static uint16_t countdown;
+static uint16_t interval;
+static uint8_t repeating;
+#if OPT_CHORDS
+static uint8_t chordWait;		// ticks left to see whether the press becomes a chord
+static uint8_t afterChord;		// a chord was held, ignore what is left until idle
+#endif
+
+void keymapReset(void)
+{
+	lastState = VAL_IDLE;
+	countdown = 0;
+	interval = 0;
+	repeating = 0;
+#if OPT_CHORDS
+	chordWait = 0;
+	afterChord = 0;
+#endif
+}
+
+uint8_t keymapRepeating(void)
+{
+	return repeating;
+}
+
+#if OPT_CHORDS
+// Non-zero if state is a button in a usable chord that the keymap does something with
+static uint8_t inMappedChord(uint8_t state)
+{
+	for (uint8_t c = 0; c < decodeChordCount; c++) {
+		const keymapEntry *e = &keymap[decodeChords[c].state];
+
+		if ((e->pressCode != KEY_NONE || e->holdCode != KEY_NONE) && decodeChordHas(decodeChords[c].state, state)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+#endif
+
+// Call once per tick with the debounced state and whether the line is idle; returns the code to send, or KEY_NONE
+uint8_t keymapDispatch(uint8_t state, uint8_t idle)
+{
+	const keymapEntry *e;
+
+	if (state >= VAL_STATES) {
+		state = VAL_IDLE;
+	}
+	e = &keymap[state];
+	repeating = 0;
+
+	if (state != lastState) {
+		/* first time */
+#if OPT_CHORDS
+		uint8_t tapped = chordWait ? keymap[lastState].pressCode : KEY_NONE;
+
+		chordWait = 0;
+		if (state >= VAL_CHORD) {
+			afterChord = 1;
+		} else if (state == VAL_IDLE) {
+			afterChord = 0;
+		}
+#endif
+		lastState = state;
+		interval = e->repeatTicks;
+		countdown = interval;
+#if OPT_CHORDS
+		if (state == VAL_IDLE || (afterChord && state < VAL_CHORD)) {
+			// let go before the wait was up (nothing is waiting after a chord)
+			return tapped;
+		}
+		if (state < VAL_CHORD && (tapped != KEY_NONE || inMappedChord(state))) {
+			// a press that was waiting goes now, so this one has to wait at least a tick
+			chordWait = inMappedChord(state) ? KEYMAP_CHORD_TICKS : 1;
+			return tapped;
+		}
+#endif
+		return e->pressCode;
+	}
+
+	/* held */
+#if OPT_CHORDS
+	if (chordWait) {
+		// no second button came, it is a press of its own
+		return --chordWait ? KEY_NONE : e->pressCode;
+	}
+	if (afterChord && state < VAL_CHORD) {
+		return KEY_NONE;
+	}
+#endif
+	if (e->holdCode == KEY_NONE) {
+		return KEY_NONE;
+	}
+	if (countdown || !idle) {
+		if (idle) {
+			countdown--;
+		}
+		return KEY_NONE;
+	}
+
+	if (interval >= e->minRepeatTicks + e->accelTicks) {
+		interval -= e->accelTicks;
+	} else {
+		interval = e->minRepeatTicks;
+	}
+	countdown = interval;
+	repeating = 1;
+	return e->holdCode;
+}
@@ -0,0 +1,58 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Button state to JVC command mapping.
+
+One entry per debounced state (VAL_*).  The compiled in table is the selected head unit's behaviour
+(headunit.h); a valid keymap block in EEPROM replaces it at boot (see settings.h for the layout) so the codes
+and repeat timing can be changed for another head unit by writing the EEPROM only.
+
+	pressCode		sent once when the state is first seen, KEY_NONE for nothing
+	holdCode		sent while the state is held, KEY_NONE for nothing
+	repeatTicks		ticks after the press before the first holdCode, and the starting gap between them
+	accelTicks		each further holdCode comes this many ticks sooner...
+	minRepeatTicks	...but never sooner than this
+
+Hold ticks are counted per call to keymapDispatch() that is made with the transmitter idle, so time spent
+sending a command is not part of the gap.  keymapRepeating() says whether the last code returned was a hold
+repeat, which the transmitter sends only for as long as the button stays held.  tools/replay.c runs this
+same code on the host.
+*/
+
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdint.h>
+#include "decode.h"
+
+#define KEY_NONE	0xFF
+
+// Gap between held seek bursts (~50ms), counted like any repeatTicks
+#define KEYMAP_SEEK_REPEAT_TICKS	95
+
+// OPT_CHORDS: how long the press of a button that starts a mapped chord waits for the second button (~50ms).
+// The first button of a chord always debounces on its own first, so without the wait every chord would send
+// that button's command ahead of its own.  Let go inside the wait and the press is sent then; once a chord
+// has been seen nothing more is sent until everything is released.
+#define KEYMAP_CHORD_TICKS			95
+
+struct keymap_entry {
+	uint8_t pressCode;
+	uint8_t holdCode;
+	uint16_t repeatTicks;
+	uint8_t accelTicks;
+	uint16_t minRepeatTicks;
+};
+typedef struct keymap_entry keymapEntry;
+
+extern keymapEntry keymap[VAL_STATES];
+
+void keymapReset(void);
+uint8_t keymapDispatch(uint8_t state, uint8_t idle);
+uint8_t keymapRepeating(void);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Steering wheel ladder profile, chosen at build time with VEHICLE (config.h).
+
+Each vehicle is a header in vehicles/ describing its ladder:
+	LADDER_NAME		text name
+	LADDER_PULLUP	ohms from 5v to the ADC pin
+	LADDER_IDLE		ohms seen with nothing pressed
+	LADDER_BUTTONS(B)	one B(state, ohms) per button, highest resistance first
+and, for a wheel with a second ladder on its own wire (OPT_LADDER2), the same again as
+	LADDER2_PULLUP, LADDER2_IDLE, LADDER2_BUTTONS(B)	using the VAL_AUXn states
+Only the selected header is ever included so other vehicles cost nothing.  To add one, copy
+vehicles/astra.h, give it a VEHICLE_xxx number in config.h and a line below, and run tools/laddervec.c
+against it to check the windows and get its test vectors.
+*/
+
+#ifndef LADDER_H
+#define LADDER_H
+
+#include "config.h"
+
+#if VEHICLE == VEHICLE_ASTRA
+#include "vehicles/astra.h"
+#else
+#error "Unknown VEHICLE"
+#endif
+
+// Expected ADC reading for a ladder resistance, rounded: Vref = Vsource = 5v, 10 bits = 1024
+#define LADDER_ADC(ohms)	((1024UL * (ohms) + ((ohms) + LADDER_PULLUP) / 2) / ((ohms) + LADDER_PULLUP))
+#define LADDER_IDLE_ADC		LADDER_ADC(LADDER_IDLE)
+
+#define LADDER_COUNT_ONE(state, ohms)	+ 1
+#define LADDER_COUNT					(0 LADDER_BUTTONS(LADDER_COUNT_ONE))
+
+#define LADDER_CENTRE(state, ohms)		LADDER_ADC(ohms),
+#define LADDER_STATE(state, ohms)		state,
+
+// Every button has to sit below idle; the order and spacing between buttons is checked by tools/laddervec.c
+#define LADDER_ABOVE_IDLE(state, ohms)	|| (LADDER_ADC(ohms) + 2 * TOLLERANCE >= LADDER_IDLE_ADC)
+#if 0 LADDER_BUTTONS(LADDER_ABOVE_IDLE)
+#error "A ladder button is within the tollerance of idle"
+#endif
+
+#if OPT_LADDER2
+#ifndef LADDER2_BUTTONS
+#error "OPT_LADDER2 needs a vehicle profile with a second ladder"
+#endif
+
+#define LADDER2_ADC(ohms)	((1024UL * (ohms) + ((ohms) + LADDER2_PULLUP) / 2) / ((ohms) + LADDER2_PULLUP))
+#define LADDER2_IDLE_ADC	LADDER2_ADC(LADDER2_IDLE)
+#define LADDER2_COUNT		(0 LADDER2_BUTTONS(LADDER_COUNT_ONE))
+#define LADDER2_CENTRE(state, ohms)		LADDER2_ADC(ohms),
+
+#define LADDER2_ABOVE_IDLE(state, ohms)	|| (LADDER2_ADC(ohms) + 2 * TOLLERANCE >= LADDER2_IDLE_ADC)
+#if 0 LADDER2_BUTTONS(LADDER2_ABOVE_IDLE)
+#error "A second ladder button is within the tollerance of idle"
+#endif
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "osctrim.h"
+
+#if OPT_OSCTRIM
+
+#include <avr/io.h>
+#include "settings.h"
+#include "telemetry.h"
+
+uint16_t osctrimTemp;
+
+static osctrimPoint table[OSCTRIM_POINTS];
+static uint8_t haveTable;
+static uint8_t target;
+static uint16_t countdown = OSCTRIM_INTERVAL;
+
+// OSCCAL bit 7 picks one of two ranges that overlap in frequency, so stepping between 0x7F and 0x80 is a
+// jump, not a step; keep every point in the range the factory value is in
+void osctrimInit(void)
+{
+	uint8_t range = OSCCAL & OSCTRIM_RANGE;
+
+	haveTable = settingsLoadOsctrim(table);
+	for (uint8_t i = 0; haveTable && i < OSCTRIM_POINTS; i++) {
+		if ((table[i].osccal & OSCTRIM_RANGE) != range) {
+			table[i].osccal = range ? OSCTRIM_RANGE : OSCTRIM_RANGE - 1;
+		}
+	}
+	target = OSCCAL;
+}
+
+// Call once per tick.  Returns 1 when this tick's ADC slot should read the temperature sensor.
+uint8_t osctrimTick(void)
+{
+	// small steps only, a big jump in clock frequency can upset the CPU
+	if (OSCCAL < target) {
+		OSCCAL++;
+	} else if (OSCCAL > target) {
+		OSCCAL--;
+	}
+
+	if (--countdown == 0) {
+		countdown = OSCTRIM_INTERVAL;
+		return 1;
+	}
+	return 0;
+}
+
+static uint8_t lookup(uint16_t temp)
+{
+	const osctrimPoint *lo = &table[0], *hi;
+
+	if (temp <= lo->temp) {
+		return lo->osccal;
+	}
+	for (uint8_t i = 1; i < OSCTRIM_POINTS; i++) {
+		hi = &table[i];
+		if (temp <= hi->temp) {
+			// linear between the two points either side
+			int16_t span = hi->osccal - lo->osccal;
+			return lo->osccal + (int16_t)((int32_t)span * (temp - lo->temp) / (hi->temp - lo->temp));
+		}
+		lo = hi;
+	}
+	return lo->osccal;
+}
+
+void osctrimSample(uint16_t raw)
+{
+	if (osctrimTemp == 0) {
+		osctrimTemp = raw;
+	} else {
+		osctrimTemp = (osctrimTemp * 3 + raw + 2) / 4;
+	}
+
+	if (haveTable) {
+		target = lookup(osctrimTemp);
+	}
+	TLM_TRIM(osctrimTemp, target);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Temperature compensated oscillator trim.
+
+The internal RC oscillator drifts a few percent between a cold and a hot dashboard, which stretches every
+JVC pulse and the tick itself.  Every OSCTRIM_INTERVAL ticks a reading of the internal temperature sensor
+(ADC4 against the 1.1v reference) is added to the end of that tick's ADC chain (adc.c), after the ladders, so
+no ladder sample is lost; OSCCAL is then walked, one step per tick, to the value this chip needs at that
+temperature.
+
+The compensation table is per chip and lives in EEPROM (settings.h): OSCTRIM_POINTS pairs of raw sensor
+reading and the OSCCAL that gives an accurate 8MHz (527us tick) at that reading, sorted by reading; repeat
+the end points if fewer are known.  Build it by running the chip at a few temperatures with telemetry on
+(TLM_TRIM records give the raw reading) and finding the OSCCAL that puts the tick on 527us.  With no valid
+table OSCCAL is left at the factory value.  OSCCAL has two ranges, 0x00-0x7F and 0x80-0xFF, whose
+frequencies overlap; the trim stays in the factory value's range, and a table point in the other one is
+taken as the end of this one.
+
+The sensor is roughly 1 count per degree C, ~300 at 25C, but the offset varies a lot between chips which
+is why the table is keyed on the raw reading.
+*/
+
+#ifndef OSCTRIM_H
+#define OSCTRIM_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define OSCTRIM_INTERVAL	4096	// ticks between temperature readings (~2.2s)
+#define OSCTRIM_POINTS		6
+#define OSCTRIM_RANGE		0x80	// OSCCAL bit 7, the low or high range
+
+struct osctrim_point {
+	uint16_t temp;		// raw sensor reading
+	uint8_t osccal;
+};
+typedef struct osctrim_point osctrimPoint;
+
+#if OPT_OSCTRIM
+
+extern uint16_t osctrimTemp;	// filtered raw sensor reading
+
+void osctrimInit(void);
+uint8_t osctrimTick(void);
+void osctrimSample(uint16_t raw);
+
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include <string.h>
+#include <avr/eeprom.h>
+#include "settings.h"
+#include "watchdog.h"
+
+static uint8_t checksum(const void *data, uint8_t len)
+{
+	const uint8_t *p = data;
+	uint8_t sum = 0;
+	while (len--) {
+		sum += *p++;
+	}
+	return sum;
+}
+
+// returns non-zero if the block is valid
+static uint8_t loadBlock(void *data, uint16_t addr, uint8_t len, uint8_t magic)
+{
+	uint8_t *p = data;
+
+	eeprom_read_block(data, (const void *)addr, len);
+	return p[0] == magic && checksum(data, len - 1) == p[len - 1];
+}
+
+// A byte at a time so the watchdog only has to cover one write (each waits for the last, ~3.4ms)
+static void saveBlock(void *data, uint16_t addr, uint8_t len, uint8_t magic)
+{
+	uint8_t *p = data;
+
+	p[0] = magic;
+	p[len - 1] = checksum(data, len - 1);
+	for (uint8_t i = 0; i < len; i++) {
+		WATCHDOG_RESET();
+		eeprom_update_byte((uint8_t *)addr + i, p[i]);
+	}
+}
+
+uint8_t settingsLoadCal(calBlock *cal)
+{
+	return loadBlock(cal, EE_CAL_ADDR, sizeof(calBlock), EE_CAL_MAGIC);
+}
+
+void settingsSaveCal(calBlock *cal)
+{
+	saveBlock(cal, EE_CAL_ADDR, sizeof(calBlock), EE_CAL_MAGIC);
+}
+
+// Replaces the compiled in keymap if the EEPROM holds a valid one
+uint8_t settingsLoadKeymap(void)
+{
+	keymapBlock block;
+
+	if (!loadBlock(&block, EE_KEYMAP_ADDR, sizeof(keymapBlock), EE_KEYMAP_MAGIC)) {
+		return 0;
+	}
+	memcpy(keymap, block.entry, sizeof(block.entry));
+	return 1;
+}
+
+#if OPT_CHORDS
+uint8_t settingsLoadChordmap(void)
+{
+	chordmapBlock block;
+
+	if (!loadBlock(&block, EE_CHORDMAP_ADDR, sizeof(chordmapBlock), EE_CHORDMAP_MAGIC)) {
+		return 0;
+	}
+	memcpy(&keymap[VAL_CHORD], block.entry, sizeof(block.entry));
+	return 1;
+}
+#endif
+
+// Fills table and returns 1 if the EEPROM holds a valid, sorted oscillator trim table
+uint8_t settingsLoadOsctrim(osctrimPoint *table)
+{
+	osctrimBlock block;
+
+	if (!loadBlock(&block, EE_OSCTRIM_ADDR, sizeof(osctrimBlock), EE_OSCTRIM_MAGIC)) {
+		return 0;
+	}
+	for (uint8_t i = 1; i < OSCTRIM_POINTS; i++) {
+		if (block.point[i].temp < block.point[i - 1].temp) {
+			return 0;
+		}
+	}
+	memcpy(table, block.point, sizeof(block.point));
+	return 1;
+}
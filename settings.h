@@ -0,0 +1,91 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Settings kept in EEPROM.
+Blocks sit at fixed addresses so a firmware update doesn't move them (program the EESAVE fuse so a chip erase
+keeps them too).  Each block starts with a magic byte and ends with an 8 bit sum; a blank (0xFF) or
+damaged block reads back as invalid and the compiled in defaults are used instead.
+*/
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include "decode.h"
+#include "keymap.h"
+#include "osctrim.h"
+
+// EEPROM layout
+#define EE_CAL_ADDR		0x000	// calBlock, 0x40 reserved
+#define EE_KEYMAP_ADDR	0x040	// keymapBlock, 0x80 reserved
+#define EE_OSCTRIM_ADDR	0x0C0	// osctrimBlock, 0x20 reserved
+#define EE_CHORDMAP_ADDR	0x0E0	// chordmapBlock, 0x80 reserved
+
+// First byte of each block; bump it when the block's layout changes, so an old block isn't loaded as a new one
+#define EE_CAL_MAGIC	0xCA
+#define EE_KEYMAP_MAGIC	0x4D	// bump when the keymap layout or the VAL_ states change
+#define EE_OSCTRIM_MAGIC	0x7C
+#define EE_CHORDMAP_MAGIC	0xC4
+
+// One learnt button: mean reading and spread (max - min) seen while it was held
+struct cal_entry {
+	uint16_t mean;
+	uint8_t spread;
+};
+typedef struct cal_entry calEntry;
+
+struct cal_block {
+	uint8_t magic;
+	calEntry idle;
+	calEntry button[DECODE_BUTTONS];	// decodeTable order
+	uint8_t check;
+};
+typedef struct cal_block calBlock;
+
+/*
+Keymap, entries in VAL_* order up to VAL_CHORD.  Each entry is 7 bytes:
+	pressCode, holdCode, repeatTicks (LE), accelTicks, minRepeatTicks (LE)
+so e.g. the block for the default table starts 4D FF FF 00 00 00 00 00 04 04 90 01 00 90 01 ...
+*/
+struct keymap_block {
+	uint8_t magic;
+	keymapEntry entry[VAL_CHORD];
+	uint8_t check;
+};
+typedef struct keymap_block keymapBlock;
+
+#if OPT_CHORDS
+// Keymap entries for the chord states, VAL_CHORD onwards, same layout as above
+struct chordmap_block {
+	uint8_t magic;
+	keymapEntry entry[DECODE_CHORDS];
+	uint8_t check;
+};
+typedef struct chordmap_block chordmapBlock;
+
+#if DECODE_CHORDS * 7 + 2 > 0x80
+#error "Chord keymap doesn't fit its EEPROM space"
+#endif
+#endif
+
+// Oscillator trim table, see osctrim.h.  Each point is raw temperature (LE), OSCCAL.
+struct osctrim_block {
+	uint8_t magic;
+	osctrimPoint point[OSCTRIM_POINTS];
+	uint8_t check;
+};
+typedef struct osctrim_block osctrimBlock;
+
+uint8_t settingsLoadCal(calBlock *cal);
+void settingsSaveCal(calBlock *cal);
+uint8_t settingsLoadKeymap(void);
+#if OPT_CHORDS
+uint8_t settingsLoadChordmap(void);
+#endif
+uint8_t settingsLoadOsctrim(osctrimPoint *table);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "stackmon.h"
+
+#if OPT_STACKMON
+
+#include <avr/io.h>
+
+// Linker symbol, the first byte after the static data
+extern uint8_t _end;
+
+volatile uint16_t stackmonFree;
+volatile uint16_t stackmonPeak;
+
+static uint8_t *stackmonScan = &_end;
+static uint8_t *stackmonLowest = (uint8_t *)(RAMEND + 1);
+
+// Runs after .init2 has set up the stack pointer and zero register but before anything is on the stack;
+// no frame, no calls
+void stackmonPaint(void) __attribute__((naked, used, section(".init3")));
+void stackmonPaint(void)
+{
+	for (uint8_t *p = &_end; p <= (uint8_t *)RAMEND; p++) {
+		*p = STACKMON_PAINT;
+	}
+}
+
+// Call once per tick from main()
+void stackmonTick(void)
+{
+	for (uint8_t n = STACKMON_CHUNK; n > 0; n--) {
+		if (stackmonScan >= stackmonLowest || *stackmonScan != STACKMON_PAINT) {
+			if (stackmonScan < stackmonLowest) {
+				stackmonLowest = stackmonScan;
+				stackmonFree = stackmonLowest - &_end;
+				stackmonPeak = (uint8_t *)(RAMEND + 1) - stackmonLowest;
+			}
+			stackmonScan = &_end;
+			return;
+		}
+		stackmonScan++;
+	}
+}
+
+#endif
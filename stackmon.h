@@ -0,0 +1,52 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Stack high-water mark.
+
+At reset, before anything has been pushed, everything from the end of the static data (_end, after
+.data, .bss and .noinit) to RAMEND is painted with STACKMON_PAINT.  The stack grows down from RAMEND into it,
+so the lowest byte that isn't paint any more is the deepest it has been, interrupts on top included.  The
+main loop looks for that byte STACKMON_CHUNK bytes a tick, from _end up, and starts again each time it finds
+it, so a full pass over the free SRAM takes a dozen or so ticks and costs up to ~40us a tick.
+
+	stackmonFree	bytes between the static data and the deepest the stack has reached: the headroom
+	stackmonPeak	bytes of stack in use at the deepest
+
+Reading them:
+- simulator: plain globals, read them by symbol (e.g. simavr + gdb)
+- on target: TLM_STACK telemetry records, every TLM_STATUS_INTERVAL ticks
+
+A byte pushed with the same value as the paint looks untouched, so the figure can read a byte or so low at
+the very bottom; it never reads high.  tools/stackuse.c gives the static worst case from the compiler to set
+against it.  With OPT_STACKMON=0 none of this is linked.
+*/
+
+#ifndef STACKMON_H
+#define STACKMON_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define STACKMON_PAINT	0xC5
+#define STACKMON_CHUNK	32		// bytes checked per tick
+
+#if OPT_STACKMON
+
+extern volatile uint16_t stackmonFree;
+extern volatile uint16_t stackmonPeak;
+
+void stackmonTick(void);
+
+#define STACKMON_TICK()	stackmonTick()
+
+#else
+
+#define STACKMON_TICK()
+
+#endif
+
+#endif
@@ -0,0 +1,235 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "telemetry.h"
+
+#if OPT_TELEMETRY
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "bitmacros.h"
+#include "cycleprof.h"
+#include "stackmon.h"
+
+// USI three wire mode, clocked from the Timer0 compare match; clock source removed when idle so the
+// register stops shifting and DO rests on the 1 at its top
+#define USI_RUN		(_BV(USIWM0) | _BV(USICS0) | _BV(USIOIE))
+#define USI_STOP	(_BV(USIWM0))
+
+// 10 bit frame sent as two halves of 5 bits: start + d0..d3, then d4..d7 + stop
+#define HALF_FRAME	5
+
+enum {TLM_IDLE, TLM_SYNC, TLM_FIRST, TLM_SECOND};
+
+static uint8_t tlmBuffer[TLM_BUFFER];
+static volatile uint8_t tlmHead, tlmTail;
+static volatile uint8_t tlmState = TLM_IDLE;
+static uint8_t tlmReversed;
+
+static uint16_t tlmTicks;
+static uint16_t tlmDropped;
+static uint8_t tlmTimingStage;
+
+static uint8_t reverseBits(uint8_t b)
+{
+	b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+	b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+	b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+	return b;
+}
+
+// Runs once per half byte, at a Timer0 compare so bit edges stay on the timebase
+ISR(USI_OVF_vect)
+{
+	switch (tlmState) {
+		case TLM_FIRST:
+			USIDR = (tlmReversed << 4) | 0x0F;
+			USISR = _BV(USIOIF) | (16 - HALF_FRAME);
+			tlmState = TLM_SECOND;
+			return;
+
+		case TLM_SYNC:
+		case TLM_SECOND:
+			if (tlmHead != tlmTail) {
+				tlmReversed = reverseBits(tlmBuffer[tlmTail]);
+				tlmTail = (tlmTail + 1) & (TLM_BUFFER - 1);
+				USIDR = ((tlmReversed >> 1) & 0x78) | 0x07;
+				USISR = _BV(USIOIF) | (16 - HALF_FRAME);
+				tlmState = TLM_FIRST;
+				return;
+			}
+			break;
+	}
+
+	// nothing left to send
+	USICR = USI_STOP;
+	USISR = _BV(USIOIF);
+	tlmState = TLM_IDLE;
+}
+
+void tlmInit(void)
+{
+	// Normal mode, F_CPU/TIMER0_PRESCALE - same setup as the profiler so either can start it
+	TCCR0A = 0;
+	TCCR0B = TIMER0_CS;
+	OCR0A = 0;
+
+	USIDR = 0xFF;
+	USICR = USI_STOP;
+	_setBit(DDRB, 1);
+}
+
+static uint8_t tlmFree(void)
+{
+	return (tlmTail - tlmHead - 1) & (TLM_BUFFER - 1);
+}
+
+void tlmRecord(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+	uint8_t header = (type << 4) | len;
+	uint8_t sum = header;
+	uint8_t sreg = SREG;
+	uint8_t head;
+
+	cli();
+	if (tlmFree() < len + 2) {
+		tlmDropped++;
+		SREG = sreg;
+		return;
+	}
+
+	head = tlmHead;
+	tlmBuffer[head] = header;
+	head = (head + 1) & (TLM_BUFFER - 1);
+	for (uint8_t i = 0; i < len; i++) {
+		tlmBuffer[head] = payload[i];
+		sum += payload[i];
+		head = (head + 1) & (TLM_BUFFER - 1);
+	}
+	tlmBuffer[head] = sum;
+	tlmHead = (head + 1) & (TLM_BUFFER - 1);
+
+	if (tlmState == TLM_IDLE) {
+		// shift out one idle bit so the first start bit begins on a compare match
+		tlmState = TLM_SYNC;
+		USIDR = 0xFF;
+		USISR = _BV(USIOIF) | (16 - 1);
+		USICR = USI_RUN;
+	}
+	SREG = sreg;
+}
+
+#if OPT_CYCLEPROF
+static void putClamped(uint8_t *p, uint32_t v)
+{
+	if (v > 0xFFFF) v = 0xFFFF;
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void tlmTiming(void)
+{
+	uint8_t p[7];
+	volatile profStats_t *s = &profStats[tlmTimingStage];
+	uint8_t sreg = SREG;
+
+	cli();
+	p[0] = tlmTimingStage;
+	putClamped(&p[1], s->count ? s->min : 0);
+	putClamped(&p[3], s->max);
+	putClamped(&p[5], s->count ? s->sum / s->count : 0);
+	SREG = sreg;
+
+	tlmRecord(TLM_TIMING, p, sizeof(p));
+	if (++tlmTimingStage >= PROF_STAGES) {
+		tlmTimingStage = 0;
+	}
+}
+#endif
+
+// Call once per tick from main()
+void tlmService(uint16_t adcVal, uint8_t state)
+{
+	uint8_t p[6];
+
+	tlmTicks++;
+
+	if ((tlmTicks % TLM_SAMPLE_INTERVAL) == 0) {
+		uint16_t packed = (adcVal & 0x3FF) | ((uint16_t)state << 10);
+		p[0] = packed;
+		p[1] = packed >> 8;
+		tlmRecord(TLM_SAMPLE, p, 2);
+	}
+
+#if OPT_CYCLEPROF
+	if ((tlmTicks % TLM_TIMING_INTERVAL) == 1) {
+		tlmTiming();
+	}
+#endif
+
+	if ((tlmTicks % TLM_STATUS_INTERVAL) == 2) {
+		uint16_t missed = 0;
+#if OPT_CYCLEPROF
+		missed = profMissedTicks;
+#endif
+		p[0] = tlmTicks;
+		p[1] = tlmTicks >> 8;
+		p[2] = tlmDropped;
+		p[3] = tlmDropped >> 8;
+		p[4] = missed;
+		p[5] = missed >> 8;
+		tlmRecord(TLM_STATUS, p, 6);
+	}
+
+#if OPT_STACKMON
+	if ((tlmTicks % TLM_STATUS_INTERVAL) == 3) {
+		uint16_t headroom = stackmonFree, peak = stackmonPeak;
+		p[0] = headroom;
+		p[1] = headroom >> 8;
+		p[2] = peak;
+		p[3] = peak >> 8;
+		tlmRecord(TLM_STACK, p, 4);
+	}
+#endif
+}
+
+void tlmDebounce(uint8_t from, uint8_t to)
+{
+	uint8_t p[4] = {tlmTicks, tlmTicks >> 8, from, to};
+	tlmRecord(TLM_DEBOUNCE, p, 4);
+}
+
+void tlmCommand(uint8_t code, uint8_t queued)
+{
+	uint8_t p[4] = {tlmTicks, tlmTicks >> 8, code, queued};
+	tlmRecord(TLM_COMMAND, p, 4);
+}
+
+void tlmTrim(uint16_t temp, uint8_t osccal)
+{
+	uint8_t p[3] = {temp, temp >> 8, osccal};
+	tlmRecord(TLM_TRIM, p, 3);
+}
+
+void tlmTick(uint32_t periodNs, uint16_t step)
+{
+	uint8_t p[6] = {periodNs, periodNs >> 8, periodNs >> 16, periodNs >> 24, step, step >> 8};
+	tlmRecord(TLM_TICK, p, 6);
+}
+
+void tlmBoot(uint8_t preSei, uint16_t loop, uint16_t press)
+{
+	uint8_t p[5] = {preSei, loop, loop >> 8, press, press >> 8};
+	tlmRecord(TLM_BOOT, p, 5);
+}
+
+void tlmReset(uint8_t cause, uint8_t stage, uint8_t resets)
+{
+	uint8_t p[3] = {cause, stage, resets};
+	tlmRecord(TLM_RESET, p, 3);
+}
+
+#endif
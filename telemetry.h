@@ -0,0 +1,88 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Binary telemetry channel.
+
+Transmit only, 8N1 at F_CPU / TIMER0_PRESCALE / 256 baud (3906.25 at 8MHz) out of PB1 (USI DO).
+The USI is clocked by the Timer0 compare match so each bit costs no CPU; one short interrupt per half byte
+reloads it.  Connect PB1 to the RX of a 5v TTL serial adapter that can do the non-standard rate (FT232R can).
+
+Records are queued into a small ring buffer.  A record that does not fit is dropped whole and counted, so
+telemetry can never hold up the main loop or the JVC timing; periodic records are decimated on top of that.
+
+Record layout:
+	header		type << 4 | payload length
+	payload		0..15 bytes, multi-byte values little endian
+	check		8 bit sum of header and payload
+
+Records:
+	TLM_SAMPLE		adc:10 | state:6 (uint16)								every TLM_SAMPLE_INTERVAL ticks
+	TLM_DEBOUNCE	tick(uint16) from(uint8) to(uint8)						each debounced state change
+	TLM_COMMAND		tick(uint16) code(uint8) queued(uint8)					each JVC command as it starts, with the number still queued behind it
+	TLM_TIMING		stage(uint8) min(uint16) max(uint16) mean(uint16)		OPT_CYCLEPROF only, one stage per TLM_TIMING_INTERVAL
+	TLM_STATUS		tick(uint16) dropped(uint16) missedTicks(uint16)		every TLM_STATUS_INTERVAL ticks
+	TLM_TRIM		temp(uint16) osccal(uint8)								OPT_OSCTRIM only, each temperature reading
+	TLM_TICK		periodNs(uint32) step(uint16)							OPT_TICKCAL only, each tick measurement
+	TLM_BOOT		preSei(uint8) loop(uint16) press(uint16)				once, at the first press after power up
+	TLM_RESET		cause(uint8) stage(uint8) resets(uint8)					OPT_WATCHDOG only, once at start
+	TLM_STACK		free(uint16) peak(uint16)								OPT_STACKMON only, every TLM_STATUS_INTERVAL ticks
+Timing figures are Timer0 counts, saturated at 0xFFFF.  tick is the telemetry tick counter (wraps).
+TLM_BOOT is the startup budget as measured: Timer1 counts from main() to sei() (0xFF if it took a whole tick or
+more), then ticks since Timer1 started to the main loop and to the first debounced press.
+TLM_RESET is watchdogLast (watchdog.h): MCUSR, the WDT_STAGE_* the watchdog caught, watchdog resets since power up.
+TLM_STACK is the stack headroom and deepest use so far in bytes (stackmon.h).
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum {TLM_SAMPLE = 1, TLM_DEBOUNCE, TLM_COMMAND, TLM_TIMING, TLM_STATUS, TLM_TRIM, TLM_TICK, TLM_BOOT, TLM_RESET, TLM_STACK};
+
+// ring buffer size, must be a power of two
+#define TLM_BUFFER			32
+
+// decimation, in ticks (~527us)
+#define TLM_SAMPLE_INTERVAL	32
+#define TLM_TIMING_INTERVAL	512
+#define TLM_STATUS_INTERVAL	2048
+
+#if OPT_TELEMETRY
+
+void tlmInit(void);
+void tlmService(uint16_t adcVal, uint8_t state);
+void tlmDebounce(uint8_t from, uint8_t to);
+void tlmCommand(uint8_t code, uint8_t queued);
+void tlmTrim(uint16_t temp, uint8_t osccal);
+void tlmTick(uint32_t periodNs, uint16_t step);
+void tlmBoot(uint8_t preSei, uint16_t loop, uint16_t press);
+void tlmReset(uint8_t cause, uint8_t stage, uint8_t resets);
+void tlmRecord(uint8_t type, const uint8_t *payload, uint8_t len);
+
+#define TLM_SERVICE(adcVal, state)	tlmService(adcVal, state)
+#define TLM_DEBOUNCE(from, to)		tlmDebounce(from, to)
+#define TLM_COMMAND(code, queued)	tlmCommand(code, queued)
+#define TLM_TRIM(temp, osccal)		tlmTrim(temp, osccal)
+#define TLM_TICK(periodNs, step)	tlmTick(periodNs, step)
+#define TLM_BOOT(preSei, loop, press)	tlmBoot(preSei, loop, press)
+#define TLM_RESET(cause, stage, resets)	tlmReset(cause, stage, resets)
+
+#else
+
+#define TLM_SERVICE(adcVal, state)
+#define TLM_DEBOUNCE(from, to)
+#define TLM_COMMAND(code, queued)
+#define TLM_TRIM(temp, osccal)
+#define TLM_TICK(periodNs, step)
+#define TLM_BOOT(preSei, loop, press)
+#define TLM_RESET(cause, stage, resets)
+
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "tickcal.h"
+
+#if OPT_TICKCAL
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "telemetry.h"
+
+#define STEP_NOMINAL	((uint16_t)TIMER1_COUNTS_X256)
+#define STEP_RANGE		((uint16_t)((uint32_t)STEP_NOMINAL * TICKCAL_RANGE_PPM / 1000000UL))
+
+volatile uint32_t tickPeriodNs;
+volatile uint16_t tickStep = STEP_NOMINAL;
+
+static uint8_t fraction;
+static uint8_t lastT0;
+static uint8_t samples;
+static uint32_t sum;
+static volatile uint32_t windowSum;
+static volatile uint8_t windowReady;
+
+void tickcalInit(void)
+{
+	// Normal mode, F_CPU/TIMER0_PRESCALE - same setup as the profiler and telemetry
+	TCCR0A = 0;
+	TCCR0B = TIMER0_CS;
+	lastT0 = TCNT0;
+}
+
+// Call first thing in the tick ISR, while TCNT1 is still a few counts past zero
+void tickcalISR(void)
+{
+	uint8_t now = TCNT0;
+	uint8_t delta = now - lastT0;
+	uint16_t next = fraction + (tickStep & 0xFF);
+
+	// next period is N or N+1 counts depending on the carry out of the fraction
+	OCR1C = (tickStep >> 8) - 1 + (next >> 8);
+	OCR1A = OCR1C;
+	fraction = next;
+
+	// Timer0 wraps more than once per tick, so take the delta as the nearest match to what we expect
+	lastT0 = now;
+	sum += TICKCAL_T0_COUNTS + (int8_t)(uint8_t)(delta - (uint8_t)TICKCAL_T0_COUNTS);
+	if (++samples == 0) {
+		windowSum = sum;
+		windowReady = 1;
+		sum = 0;
+	}
+}
+
+// Call from the main loop; does the arithmetic the ISR shouldn't
+void tickcalService(void)
+{
+	uint32_t period;
+	int32_t error;
+	uint16_t step;
+
+	if (!windowReady) {
+		return;
+	}
+	cli();
+	period = windowSum;
+	windowReady = 0;
+	sei();
+
+	// Timer0 counts per TICKCAL_WINDOW ticks -> ns per tick
+	period = (period * (TIMER0_PRESCALE * 1000UL / (F_CPU / 1000000UL)) + TICKCAL_WINDOW / 2) / TICKCAL_WINDOW;
+	tickPeriodNs = period;
+
+	// scale the step by the error, within range of what the numbers say it should be
+	error = (int32_t)TICK_NS - (int32_t)period;
+	step = tickStep + (int16_t)(error * (int32_t)tickStep / (int32_t)TICK_NS);
+	if (step > STEP_NOMINAL + STEP_RANGE) step = STEP_NOMINAL + STEP_RANGE;
+	if (step < STEP_NOMINAL - STEP_RANGE) step = STEP_NOMINAL - STEP_RANGE;
+
+	cli();
+	tickStep = step;
+	sei();
+
+	TLM_TICK(period, step);
+}
+
+#endif
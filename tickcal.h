@@ -0,0 +1,49 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Self calibrating tick.
+
+An 8 bit compare can only get the tick to the nearest Timer1 count (528us for a 527us unit at 8MHz).
+Instead the compare value is dithered between N and N+1 counts from a fractional accumulator so the
+average period is the exact tick.  The step it adds each tick (counts x256) starts at the compile time
+value and is then checked continuously: every TICKCAL_WINDOW ticks the interrupt to interrupt period is
+measured against Timer0 and the step is corrected towards TICK_NS, within TICKCAL_RANGE_PPM of the
+computed value.  The last measurement is kept in tickPeriodNs for diagnostics (and the TLM_TICK record).
+
+Timer0 runs from the same oscillator, so this takes care of compare rounding and anything that upsets the
+tick interrupt, not oscillator drift - that is what osctrim is for.
+*/
+
+#ifndef TICKCAL_H
+#define TICKCAL_H
+
+#include <stdint.h>
+#include "config.h"
+#include "timing.h"
+
+#define TICKCAL_WINDOW		256		// ticks per measurement, must be 256 (8 bit counter)
+#define TICKCAL_RANGE_PPM	20000	// how far the step may be moved from the computed value
+
+// Timer0 counts expected per tick
+#define TICKCAL_T0_COUNTS	(((TICK_NS / 100UL) * (F_CPU / 10000UL) / TIMER0_PRESCALE + 500UL) / 1000UL)
+
+#if TICKCAL_T0_COUNTS < 64
+#error "Timer0 is too coarse to measure the tick"
+#endif
+
+#if OPT_TICKCAL
+
+extern volatile uint32_t tickPeriodNs;	// measured, 0 until the first window completes
+extern volatile uint16_t tickStep;		// Timer1 counts per tick x256
+
+void tickcalInit(void);
+void tickcalISR(void);
+void tickcalService(void);
+
+#endif
+
+#endif
@@ -0,0 +1,138 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Tick and protocol timing, all worked out at compile time from the head unit profile (headunit.h).
+
+Timer1 produces the tick that everything is timed from (sampling, debounce, protocol pulses).  It runs from the
+system clock, or with OPT_TIMER1_PLL from the 64MHz PLL, which gives a finer count and leaves F_CPU free to
+be lowered (CKDIV8 / CLKPR) without touching the protocol timing.  The prescaler and compare value are picked
+from the clock and TICK_NS, and the build fails if the tick or any protocol duration can't be hit within
+TICK_MAX_ERROR_PPM.
+
+	clock		prescale	count	tick (KD-X351BT, 527us unit)
+	8MHz		32			132		528us
+	1MHz		4			132		528us
+	64MHz PLL	256			132		528us	(any F_CPU)
+*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "config.h"
+#include "headunit.h"
+
+// One head unit protocol unit; the tick is one unit
+#define TICK_NS				HU_UNIT_NS
+#define TICK_MAX_ERROR_PPM	2000
+
+#if OPT_TIMER1_PLL
+#define TIMER1_HZ			64000000UL
+#else
+#define TIMER1_HZ			F_CPU
+#endif
+
+// Timer1 input clocks per tick, rounded (split up to stay inside 32 bits for the compiler)
+#define TIMER1_TICK_CLOCKS	(((TIMER1_HZ / 10000UL) * (TICK_NS / 100UL) + 500UL) / 1000UL)
+
+// Smallest prescaler that fits the 8 bit counter; Timer1 CS13:0 = n divides by 2^(n-1)
+#if TIMER1_TICK_CLOCKS <= 256
+#define TIMER1_CS	1
+#elif TIMER1_TICK_CLOCKS <= 256UL * 2
+#define TIMER1_CS	2
+#elif TIMER1_TICK_CLOCKS <= 256UL * 4
+#define TIMER1_CS	3
+#elif TIMER1_TICK_CLOCKS <= 256UL * 8
+#define TIMER1_CS	4
+#elif TIMER1_TICK_CLOCKS <= 256UL * 16
+#define TIMER1_CS	5
+#elif TIMER1_TICK_CLOCKS <= 256UL * 32
+#define TIMER1_CS	6
+#elif TIMER1_TICK_CLOCKS <= 256UL * 64
+#define TIMER1_CS	7
+#elif TIMER1_TICK_CLOCKS <= 256UL * 128
+#define TIMER1_CS	8
+#elif TIMER1_TICK_CLOCKS <= 256UL * 256
+#define TIMER1_CS	9
+#elif TIMER1_TICK_CLOCKS <= 256UL * 512
+#define TIMER1_CS	10
+#elif TIMER1_TICK_CLOCKS <= 256UL * 1024
+#define TIMER1_CS	11
+#elif TIMER1_TICK_CLOCKS <= 256UL * 2048
+#define TIMER1_CS	12
+#elif TIMER1_TICK_CLOCKS <= 256UL * 4096
+#define TIMER1_CS	13
+#elif TIMER1_TICK_CLOCKS <= 256UL * 8192
+#define TIMER1_CS	14
+#elif TIMER1_TICK_CLOCKS <= 256UL * 16384
+#define TIMER1_CS	15
+#else
+#error "Tick too long for Timer1"
+#endif
+
+#define TIMER1_PRESCALE		(1UL << (TIMER1_CS - 1))
+#define TIMER1_COUNTS		((TIMER1_TICK_CLOCKS + TIMER1_PRESCALE / 2) / TIMER1_PRESCALE)
+#define TIMER1_OCR			(TIMER1_COUNTS - 1)
+
+// Exact counts per tick in 1/256ths, for the fractional compare in tickcal.c (8MHz: 131.75 -> 33728)
+#define TIMER1_COUNTS_X256	((((TIMER1_HZ / 10000ULL) * (TICK_NS / 100ULL) * 256ULL + 500ULL) / 1000ULL \
+								+ TIMER1_PRESCALE / 2) / TIMER1_PRESCALE)
+
+// The tick actually produced
+#define TICK_ACTUAL_NS		((TIMER1_COUNTS * TIMER1_PRESCALE * 1000000000ULL + TIMER1_HZ / 2) / TIMER1_HZ)
+
+#define TIMING_ERROR_PPM(actual, wanted) \
+	(((actual) > (wanted) ? (actual) - (wanted) : (wanted) - (actual)) * 1000000ULL / (wanted))
+
+#if TIMING_ERROR_PPM(TICK_ACTUAL_NS, TICK_NS) > TICK_MAX_ERROR_PPM
+#error "Timer1 can't produce TICK_NS from this clock within TICK_MAX_ERROR_PPM"
+#endif
+
+// Protocol durations, and the number of ticks each one takes
+#define TICKS(ns)			(((ns) + TICK_ACTUAL_NS / 2) / TICK_ACTUAL_NS)
+#define TICKS_ERROR_PPM(ns)	TIMING_ERROR_PPM(TICKS(ns) * TICK_ACTUAL_NS, (ns))
+
+#define HU_RESET_NS			(HU_RESET_UNITS * HU_UNIT_NS)		// bus reset, line released
+#define HU_LEAD_LOW_NS		(HU_LEAD_LOW_UNITS * HU_UNIT_NS)	// header AGC, line held low
+#define HU_LEAD_HIGH_NS		(HU_LEAD_HIGH_UNITS * HU_UNIT_NS)	// header AGC, line released
+#define HU_MARK_NS			(HU_MARK_UNITS * HU_UNIT_NS)		// low part of every bit
+#define HU_SPACE0_NS		(HU_SPACE0_UNITS * HU_UNIT_NS)		// high part of a 0
+#define HU_SPACE1_NS		(HU_SPACE1_UNITS * HU_UNIT_NS)		// high part of a 1
+
+#define HU_RESET_TICKS		TICKS(HU_RESET_NS)
+#define HU_LEAD_LOW_TICKS	TICKS(HU_LEAD_LOW_NS)
+#define HU_LEAD_HIGH_TICKS	TICKS(HU_LEAD_HIGH_NS)
+#define HU_MARK_TICKS		TICKS(HU_MARK_NS)
+#define HU_SPACE0_TICKS		TICKS(HU_SPACE0_NS)
+#define HU_SPACE1_TICKS		TICKS(HU_SPACE1_NS)
+
+#if TICKS_ERROR_PPM(HU_RESET_NS) > TICK_MAX_ERROR_PPM || TICKS_ERROR_PPM(HU_LEAD_LOW_NS) > TICK_MAX_ERROR_PPM \
+	|| TICKS_ERROR_PPM(HU_LEAD_HIGH_NS) > TICK_MAX_ERROR_PPM || TICKS_ERROR_PPM(HU_MARK_NS) > TICK_MAX_ERROR_PPM \
+	|| TICKS_ERROR_PPM(HU_SPACE0_NS) > TICK_MAX_ERROR_PPM || TICKS_ERROR_PPM(HU_SPACE1_NS) > TICK_MAX_ERROR_PPM
+#error "A head unit protocol duration is not a whole number of ticks within TICK_MAX_ERROR_PPM"
+#endif
+
+// ADC clock has to be 50-200kHz; use the fastest that is still under 200kHz (/64 at 8MHz, 104us a
+// conversion) so every channel the scheduler in adc.c wants fits in one tick
+#if F_CPU / 2 <= 200000UL
+#define ADC_PRESCALE_BITS	1
+#elif F_CPU / 4 <= 200000UL
+#define ADC_PRESCALE_BITS	2
+#elif F_CPU / 8 <= 200000UL
+#define ADC_PRESCALE_BITS	3
+#elif F_CPU / 16 <= 200000UL
+#define ADC_PRESCALE_BITS	4
+#elif F_CPU / 32 <= 200000UL
+#define ADC_PRESCALE_BITS	5
+#elif F_CPU / 64 <= 200000UL
+#define ADC_PRESCALE_BITS	6
+#elif F_CPU / 128 <= 200000UL
+#define ADC_PRESCALE_BITS	7
+#else
+#error "F_CPU too high for the ADC"
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Flash and SRAM footprint by subsystem, checked against budgets.  Reads the symbol table of the linked
+firmware, with each symbol's source file, and adds every symbol's size to the subsystem its file belongs to.
+Runs on the host.
+
+	avr-gcc -mmcu=attiny85 -Os -g -DF_CPU=8000000UL -o astrajvcbridge.elf *.c
+	gcc -O2 -I. -o footprint tools/footprint.c
+	avr-nm -S -l -t d astrajvcbridge.elf | ./footprint [-v] [-r bytes]
+
+	-v			every symbol under its subsystem
+	-r bytes	SRAM kept back for the stack (default FOOTPRINT_STACK, see tools/stackuse.c for a real figure)
+
+Build it with the same -D options as the firmware: the budgets below follow the options, so each feature
+declares what it may cost.  -g is needed for the source files (it doesn't change the image).  Code and
+constants in flash count as flash; initialised data counts as both, as its first values are copied from
+flash; .bss and .noinit count as SRAM.  Symbols with no source file (the vector table, C runtime, libgcc and
+avr-libc) are runtime.  Only symbols with a size are counted, so the totals come out a little under
+avr-size's, which is the one that has to fit.
+
+Exits 1 if the totals don't fit the ATtiny85 (8K flash, and 512 bytes of SRAM less the stack reserve).
+
+The subsystem budgets are starting figures, not yet measured against avr-gcc, so for now a subsystem over
+budget is only marked.  Once each option set has been run through a real avr-nm and the budgets set from it,
+note the avr-gcc version here and set FOOTPRINT_BUDGETS_MEASURED to 1 to fail on them too.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+
+#define FLASH_BYTES		8192
+#define SRAM_BYTES		512
+#define SRAM_START		0x800000UL	// avr-gcc's data address space
+#define EEPROM_START	0x810000UL
+#define FOOTPRINT_STACK	128
+#define FOOTPRINT_BUDGETS_MEASURED	0	// fail on a subsystem over budget, see above
+
+// name, source files, flash budget, SRAM budget (bytes) for this build's options
+#define SUBSYSTEMS(S) \
+	S("scheduler",	"astrajvcbridge.c jvc.c tickcal.c watchdog.c", \
+		2600 + OPT_ADAPTIVE_DEBOUNCE * 128 + OPT_ENCODER * 128 + OPT_TELEMETRY * 256, \
+		128 + OPT_ADAPTIVE_DEBOUNCE * 16 + OPT_LADDER2 * 16) \
+	S("adc",		"adc.c",			600 + OPT_LADDER2 * 64 + OPT_OSCTRIM * 64,	24) \
+	S("decode",		"decode.c",			400 + OPT_CHORDS * 1200 + OPT_LADDER2 * 200, \
+		64 + OPT_CHORDS * 160 + OPT_LADDER2 * 32) \
+	S("debounce",	"debounce.c",		320 + OPT_ADAPTIVE_DEBOUNCE * 448 + (OPT_DIGITAL != 0) * 128,	8) \
+	S("encoder",	"encoder.c",		OPT_ENCODER * 480,	OPT_ENCODER * 24) \
+	S("keymap",		"keymap.c",			400 + OPT_CHORDS * 128,	128 + OPT_CHORDS * 128) \
+	S("settings",	"calibrate.c settings.c osctrim.c", \
+		640 + OPT_CALIBRATE * 1280 + OPT_OSCTRIM * 480 + OPT_CHORDS * 128,	8 + OPT_OSCTRIM * 32) \
+	S("diagnostics", "telemetry.c cycleprof.c stackmon.c", \
+		OPT_TELEMETRY * 1700 + OPT_CYCLEPROF * 680 + OPT_STACKMON * 256, \
+		OPT_TELEMETRY * 48 + OPT_CYCLEPROF * 128 + OPT_STACKMON * 12) \
+	S("runtime",	"",					512,	8)
+
+#define NAME(name, files, flash, sram)		name,
+#define FILES(name, files, flash, sram)		files,
+#define FLASH(name, files, flash, sram)		flash,
+#define SRAM(name, files, flash, sram)		sram,
+
+static const char *names[] = { SUBSYSTEMS(NAME) };
+static const char *files[] = { SUBSYSTEMS(FILES) };
+static const long flashBudget[] = { SUBSYSTEMS(FLASH) };
+static const long sramBudget[] = { SUBSYSTEMS(SRAM) };
+
+#define SUBSYSTEM_COUNT		((int)(sizeof(names) / sizeof(names[0])))
+#define RUNTIME				(SUBSYSTEM_COUNT - 1)
+
+struct footprint_symbol {
+	char name[64];
+	int subsystem;
+	long flash, sram;
+};
+typedef struct footprint_symbol footprintSymbol;
+
+#define MAX_SYMBOLS		1024
+
+static footprintSymbol symbols[MAX_SYMBOLS];
+static int symbolCount;
+
+// Subsystem whose file list has the base name of path in it
+static int subsystemOf(const char *path)
+{
+	const char *base = strrchr(path, '/');
+	size_t len;
+
+	base = base ? base + 1 : path;
+	len = strcspn(base, ":");
+	if (!len) {
+		return RUNTIME;
+	}
+	for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+		for (const char *f = files[i]; *f; ) {
+			size_t flen = strcspn(f, " ");
+
+			if (flen == len && strncmp(f, base, len) == 0) {
+				return i;
+			}
+			f += flen;
+			f += strspn(f, " ");
+		}
+	}
+	return RUNTIME;
+}
+
+// One line of avr-nm -S -l -t d: address size type name [file:line]; symbols with no size have no size field
+static int readSymbol(char *line, footprintSymbol *sym)
+{
+	char *tab = strchr(line, '\t');
+	unsigned long addr;
+	long size;
+	char type;
+
+	if (tab) {
+		*tab++ = 0;
+		tab[strcspn(tab, "\r\n")] = 0;
+	}
+	if (sscanf(line, "%lu %ld %c %63s", &addr, &size, &type, sym->name) != 4 || size <= 0) {
+		return 0;
+	}
+	sym->subsystem = subsystemOf(tab ? tab : "");
+	sym->flash = sym->sram = 0;
+	if (addr < SRAM_START) {
+		sym->flash = size;
+	} else if (addr < EEPROM_START) {
+		sym->sram = size;
+		if (strchr("dDrRgG", type)) {
+			sym->flash = size;
+		}
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	int verbose = 0, stack = FOOTPRINT_STACK, over = 0, overBudget = 0, withFiles = 0;
+	long flash[SUBSYSTEM_COUNT] = {0}, sram[SUBSYSTEM_COUNT] = {0}, flashTotal = 0, sramTotal = 0;
+	char line[512];
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-v") == 0) {
+			verbose = 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			stack = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: avr-nm -S -l -t d firmware.elf | footprint [-v] [-r bytes]\n");
+			return 2;
+		}
+	}
+
+	while (fgets(line, sizeof(line), stdin)) {
+		footprintSymbol *sym = &symbols[symbolCount];
+
+		if (strchr(line, '\t')) {
+			withFiles = 1;
+		}
+		if (!readSymbol(line, sym)) {
+			continue;
+		}
+		flash[sym->subsystem] += sym->flash;
+		sram[sym->subsystem] += sym->sram;
+		flashTotal += sym->flash;
+		sramTotal += sym->sram;
+		if (symbolCount < MAX_SYMBOLS - 1) {
+			symbolCount++;
+		}
+	}
+	if (!symbolCount) {
+		fprintf(stderr, "no symbols with sizes on stdin\n");
+		return 2;
+	}
+	if (!withFiles) {
+		fprintf(stderr, "no source files in the symbols, build with -g and use avr-nm -l: all counted as runtime\n");
+	}
+
+	printf("%-32s %6s %6s   %5s %5s\n", "subsystem", "flash", "budget", "sram", "budget");
+	for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+		int flashOver = flash[i] > flashBudget[i], sramOver = sram[i] > sramBudget[i];
+
+		printf("%-32s %6ld %6ld%s  %5ld %5ld%s\n", names[i], flash[i], flashBudget[i], flashOver ? "!" : " ",
+			sram[i], sramBudget[i], sramOver ? "!" : " ");
+		overBudget |= flashOver | sramOver;
+		if (verbose) {
+			for (int s = 0; s < symbolCount; s++) {
+				if (symbols[s].subsystem == i) {
+					printf("  %-30s %6ld %9s%5ld\n", symbols[s].name, symbols[s].flash, "", symbols[s].sram);
+				}
+			}
+		}
+	}
+
+	int flashOver = flashTotal > FLASH_BYTES, sramOver = sramTotal > SRAM_BYTES - stack;
+	printf("%-32s %6ld %6d%s  %5ld %5d%s  (%d of SRAM kept for the stack)\n", "total", flashTotal, FLASH_BYTES,
+		flashOver ? "!" : " ", sramTotal, SRAM_BYTES - stack, sramOver ? "!" : " ", stack);
+	over = flashOver | sramOver;
+	if (over) {
+		printf("doesn't fit the ATtiny85, marked !\n");
+	}
+	if (overBudget) {
+		printf("over budget, marked !%s\n", FOOTPRINT_BUDGETS_MEASURED ? "" : " (budgets not measured yet, not failed)");
+		over |= FOOTPRINT_BUDGETS_MEASURED;
+	}
+	return over;
+}
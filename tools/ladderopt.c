@@ -0,0 +1,253 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Ladder pull-up optimiser.  Takes the selected vehicle profile's ladder resistances, works out where each
+button and idle can read once component tolerances are allowed for, and picks the pull-up that leaves the
+most clear ADC counts between the closest two of them.  Runs on the host.
+
+	gcc -O2 -I. -o ladderopt tools/ladderopt.c
+	./ladderopt [-t pct] [-p pct] [-a counts] [-e series] [-n name] [-o header]
+
+	-t pct		ladder resistor tolerance (default 5)
+	-p pct		pull-up tolerance (default 1)
+	-a counts	ADC error on top, offset + gain + noise (default 2)
+	-e series	E series to pick the pull-up from: 12, 24 (default), 48, 96, or 0 for any whole ohm
+	-n name		LADDER_NAME for the header (default the profile's with the pull-up added)
+	-o header	write a vehicle profile for the chosen pull-up, e.g. vehicles/astra_1k.h
+
+The reading for a resistance R against pull-up Rp is 1024 R / (R + Rp), so it goes up with R and down with
+Rp and its extremes are at the corners of both tolerances.  The margin between two neighbouring levels is
+the lowest the upper one can read less the highest the lower one can read; the pull-up chosen has the
+largest smallest margin.  The report also gives the TOLLERANCE range that works with it: at least the
+widest spread of any level (so a window covers every part that's in tolerance) and under half the closest
+centre spacing (so windows don't touch, as tools/laddervec.c checks).  Build with -DVEHICLE=VEHICLE_xxx to
+optimise another profile; the header written is in the same form as vehicles/astra.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "decode.h"
+
+#define OHMS(state, ohms)		ohms,
+#define NAME(state, ohms)		#state,
+static const unsigned long ohms[] = { LADDER_BUTTONS(OHMS) };
+static const char *states[] = { LADDER_BUTTONS(NAME) };
+
+#define LEVELS			(DECODE_BUTTONS + 1)	// idle first, then the buttons
+#define MIN_PULLUP		10UL
+#define MAX_PULLUP		100000UL
+
+static const uint16_t e12[] = {100, 120, 150, 180, 220, 270, 330, 390, 470, 560, 680, 820};
+static const uint16_t e24[] = {100, 110, 120, 130, 150, 160, 180, 200, 220, 240, 270, 300, 330, 360, 390, 430, 470,
+	510, 560, 620, 680, 750, 820, 910};
+static const uint16_t e48[] = {100, 105, 110, 115, 121, 127, 133, 140, 147, 154, 162, 169, 178, 187, 196, 205, 215,
+	226, 237, 249, 261, 274, 287, 301, 316, 332, 348, 365, 383, 402, 422, 442, 464, 487, 511, 536, 562, 590, 619,
+	649, 681, 715, 750, 787, 825, 866, 909, 953};
+static const uint16_t e96[] = {100, 102, 105, 107, 110, 113, 115, 118, 121, 124, 127, 130, 133, 137, 140, 143, 147,
+	150, 154, 158, 162, 165, 169, 174, 178, 182, 187, 191, 196, 200, 205, 210, 215, 221, 226, 232, 237, 243, 249,
+	255, 261, 267, 274, 280, 287, 294, 301, 309, 316, 324, 332, 340, 348, 357, 365, 374, 383, 392, 402, 412, 422,
+	432, 442, 453, 464, 475, 487, 499, 511, 523, 536, 549, 562, 576, 590, 604, 619, 634, 649, 665, 681, 698, 715,
+	732, 750, 768, 787, 806, 825, 845, 866, 887, 909, 931, 953, 976};
+
+struct ladder_level {
+	unsigned long ohms;
+	uint16_t centre;		// as LADDER_ADC() works it out
+	double lo, hi;			// extremes with every tolerance against it
+};
+typedef struct ladder_level ladderLevel;
+
+struct ladder_fit {
+	unsigned long pullup;
+	ladderLevel level[LEVELS];
+	double margin;			// smallest gap between neighbouring levels' extremes
+	int closest;			// level whose gap to the one below it is the smallest
+	double spread;			// widest half spread of any level about its centre
+	int spacing;			// smallest gap between neighbouring centres
+};
+typedef struct ladder_fit ladderFit;
+
+static double tolR = 0.05, tolP = 0.01, adcErr = 2;
+
+static double reading(double r, double rp)
+{
+	return 1024.0 * r / (r + rp);
+}
+
+static void fit(ladderFit *f, unsigned long pullup)
+{
+	f->pullup = pullup;
+	f->margin = 1e9;
+	f->spread = 0;
+	f->spacing = 1024;
+	f->closest = 0;
+
+	for (int i = 0; i < LEVELS; i++) {
+		ladderLevel *l = &f->level[i];
+		unsigned long r = i ? ohms[i - 1] : LADDER_IDLE;
+
+		l->ohms = r;
+		l->centre = (1024UL * r + (r + pullup) / 2) / (r + pullup);
+		l->lo = reading(r * (1 - tolR), pullup * (1 + tolP)) - adcErr;
+		l->hi = reading(r * (1 + tolR), pullup * (1 - tolP)) + adcErr;
+		if (l->centre - l->lo > f->spread) f->spread = l->centre - l->lo;
+		if (l->hi - l->centre > f->spread) f->spread = l->hi - l->centre;
+
+		if (i) {
+			const ladderLevel *above = &f->level[i - 1];
+
+			if (above->lo - l->hi < f->margin) {
+				f->margin = above->lo - l->hi;
+				f->closest = i;
+			}
+			if (above->centre - l->centre < f->spacing) {
+				f->spacing = above->centre - l->centre;
+			}
+		}
+	}
+}
+
+static const char *levelName(int i)
+{
+	return i ? states[i - 1] : "idle";
+}
+
+static void report(const ladderFit *f, const char *title)
+{
+	// windows are centre +- TOLLERANCE and have to stay apart, the idle one needs twice that (ladder.h)
+	int most = (f->spacing - 1) / 2;
+	int least = (int)(f->spread + 0.999);
+
+	printf("%s: pull-up %lu ohm, worst margin %.1f counts between %s and %s\n", title, f->pullup, f->margin,
+		levelName(f->closest - 1), levelName(f->closest));
+	printf("  %-14s %6s %6s %8s %8s\n", "level", "ohms", "centre", "lowest", "highest");
+	for (int i = 0; i < LEVELS; i++) {
+		printf("  %-14s %6lu %6u %8.1f %8.1f\n", levelName(i), f->level[i].ohms, f->level[i].centre,
+			f->level[i].lo, f->level[i].hi);
+	}
+	if (least <= most) {
+		printf("  TOLLERANCE %d..%d works (currently %d)\n", least, most, TOLLERANCE);
+	} else {
+		printf("  no TOLLERANCE works: spreads need %d, spacing allows %d\n", least, most);
+	}
+}
+
+static int writeHeader(const ladderFit *f, const char *path, const char *name)
+{
+	FILE *out = fopen(path, "w");
+
+	if (!out) {
+		perror(path);
+		return 0;
+	}
+	fprintf(out, "/*\n(c) Mark Smith 2018\nGPL v3\nNot licensed for commercial use\n*/\n\n");
+	fprintf(out, "/*\n%s steering wheel ladder, pull-up chosen by tools/ladderopt.c.\n", name);
+	fprintf(out, "Worst case margin %.1f counts (%s to %s) with %.0f%% ladder resistors, a %.0f%% pull-up and %.0f counts\n"
+		"of ADC error.\n*/\n\n", f->margin, levelName(f->closest - 1), levelName(f->closest), tolR * 100, tolP * 100,
+		adcErr);
+	fprintf(out, "#define LADDER_NAME\t\t\"%s\"\n", name);
+	fprintf(out, "#define LADDER_PULLUP\t%lu\t\t// ohms, 5v to the ADC pin\n", f->pullup);
+	fprintf(out, "#define LADDER_IDLE\t\t%lu\t// ohms, nothing pressed\n\n", (unsigned long)LADDER_IDLE);
+	fprintf(out, "// state, ohms - highest resistance (highest ADC value) first\n");
+	fprintf(out, "#define LADDER_BUTTONS(B) \\\n");
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		// line the resistances up at column 20 with 4 column tabs, as the hand written profiles are
+		int column = 4 + 2 + (int)strlen(states[i]) + 1;
+
+		fprintf(out, "\tB(%s,", states[i]);
+		do {
+			fputc('\t', out);
+			column = (column / 4 + 1) * 4;
+		} while (column < 20);
+		fprintf(out, "%lu)\t/* ADC %u */%s\n", ohms[i], f->level[i + 1].centre, i < DECODE_BUTTONS - 1 ? " \\" : "");
+	}
+	fclose(out);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const uint16_t *series = e24;
+	size_t seriesLen = sizeof(e24) / sizeof(e24[0]);
+	const char *outPath = NULL;
+	char name[64];
+	ladderFit current, best, f;
+
+	snprintf(name, sizeof(name), "%s", LADDER_NAME);
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc) {
+			fprintf(stderr, "usage: ladderopt [-t pct] [-p pct] [-a counts] [-e series] [-n name] [-o header]\n");
+			return 2;
+		}
+		if (strcmp(argv[i], "-t") == 0) {
+			tolR = atof(argv[++i]) / 100;
+		} else if (strcmp(argv[i], "-p") == 0) {
+			tolP = atof(argv[++i]) / 100;
+		} else if (strcmp(argv[i], "-a") == 0) {
+			adcErr = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-e") == 0) {
+			switch (atoi(argv[++i])) {
+				case 0: series = NULL; break;
+				case 12: series = e12; seriesLen = sizeof(e12) / sizeof(e12[0]); break;
+				case 24: series = e24; seriesLen = sizeof(e24) / sizeof(e24[0]); break;
+				case 48: series = e48; seriesLen = sizeof(e48) / sizeof(e48[0]); break;
+				case 96: series = e96; seriesLen = sizeof(e96) / sizeof(e96[0]); break;
+				default: fprintf(stderr, "E series is 0, 12, 24, 48 or 96\n"); return 2;
+			}
+		} else if (strcmp(argv[i], "-n") == 0) {
+			snprintf(name, sizeof(name), "%s", argv[++i]);
+		} else if (strcmp(argv[i], "-o") == 0) {
+			outPath = argv[++i];
+		} else {
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	printf("%s: %d buttons, %.1f%% ladder, %.1f%% pull-up, %.1f counts ADC error\n\n", LADDER_NAME,
+		DECODE_BUTTONS, tolR * 100, tolP * 100, adcErr);
+	fit(&current, LADDER_PULLUP);
+	report(&current, "current");
+
+	best.margin = -1e9;
+	if (series) {
+		for (unsigned long decade = 1; decade * 100 <= MAX_PULLUP; decade *= 10) {
+			for (size_t i = 0; i < seriesLen; i++) {
+				unsigned long rp = series[i] * decade / 10;
+
+				if (rp < MIN_PULLUP) {
+					continue;
+				}
+				fit(&f, rp);
+				if (f.margin > best.margin) {
+					best = f;
+				}
+			}
+		}
+	} else {
+		for (unsigned long rp = MIN_PULLUP; rp <= MAX_PULLUP; rp++) {
+			fit(&f, rp);
+			if (f.margin > best.margin) {
+				best = f;
+			}
+		}
+	}
+	printf("\n");
+	report(&best, "best");
+	printf("\n%+.1f counts of worst case margin over the current pull-up\n", best.margin - current.margin);
+
+	if (outPath) {
+		if (strcmp(name, LADDER_NAME) == 0) {
+			snprintf(name, sizeof(name), "%s %lu ohm", LADDER_NAME, best.pullup);
+		}
+		if (!writeHeader(&best, outPath, name)) {
+			return 1;
+		}
+		printf("wrote %s\n", outPath);
+	}
+	return best.margin > 0 ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Ladder profile checker, test vector generator and decode benchmark.  Runs on the host.
+
+	gcc -O2 -I. -o laddervec tools/laddervec.c decode.c
+	./laddervec			summary, checks, benchmark
+	./laddervec -v		also print the test vectors as a C table: {adc, state},
+
+Build with -DVEHICLE=VEHICLE_xxx for another profile, and -DOPT_CHORDS=1 to list which two button chords
+can be decoded with the profile's windows and check the bucketed lookup against them.
+
+The checks are that buttons are listed from highest to lowest reading and that no two windows (or a window
+and idle) overlap; every ADC value 0..1023 is then decoded and compared against the windows worked out
+independently from the profile.  Exits non-zero if anything fails.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "decode.h"
+
+static const char *stateNames[VAL_CHORD] = {
+	"IDLE", "VOLUP", "VOLDN", "SRC", "SEEKFWD", "SEEKBK", "SOUND", "AUX1", "AUX2", "AUX3", "AUX4", "DIG1", "DIG2", "DIG3"
+};
+
+#define OHMS(state, ohms)	ohms,
+static const unsigned long ohms[] = { LADDER_BUTTONS(OHMS) };
+static const uint16_t centre[] = { LADDER_BUTTONS(LADDER_CENTRE) };
+static const uint8_t state[] = { LADDER_BUTTONS(LADDER_STATE) };
+
+static const char *name(uint8_t s)
+{
+#if OPT_CHORDS
+	static char buf[4][24];
+	static int next;
+
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		for (int j = i + 1; j < DECODE_BUTTONS; j++) {
+			if (decodeChordState(i, j) == s) {
+				next = (next + 1) % 4;
+				snprintf(buf[next], sizeof(buf[next]), "%s+%s", stateNames[state[i]], stateNames[state[j]]);
+				return buf[next];
+			}
+		}
+	}
+#endif
+	return s < VAL_CHORD ? stateNames[s] : "?";
+}
+
+// Reference decode straight from the profile, plus whichever chords decodeBuild() kept
+static uint8_t expected(uint16_t adc)
+{
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		int lower = (int)centre[i] - TOLLERANCE;
+		if (lower < 0) lower = 0;
+		if ((int)adc >= lower && adc <= centre[i] + TOLLERANCE) {
+			return state[i];
+		}
+	}
+#if OPT_CHORDS
+	for (int c = 0; c < decodeChordCount; c++) {
+		if (adc >= decodeChords[c].lower && adc <= decodeChords[c].upper) {
+			return decodeChords[c].state;
+		}
+	}
+#endif
+	return VAL_IDLE;
+}
+
+#if OPT_CHORDS
+// Each pair's level worked out in ohms from the profile, against what decodeBuild() made of it
+static int checkChords(void)
+{
+	int failed = 0;
+
+	printf("%-16s %6s %6s %6s  %s\n", "chord", "ohms", "centre", "decode", "window");
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		for (int j = i + 1; j < DECODE_BUTTONS; j++) {
+			double r = 1.0 / (1.0 / ohms[i] + 1.0 / ohms[j] - 1.0 / LADDER_IDLE);
+			int want = (int)(1024.0 * r / (r + LADDER_PULLUP) + 0.5);
+			uint8_t s = decodeChordState(i, j);
+			int c;
+
+			for (c = 0; c < decodeChordCount && decodeChords[c].state != s; c++);
+			if (c < decodeChordCount) {
+				int got = (decodeChords[c].lower + decodeChords[c].upper + 1) / 2;
+				printf("%-16s %6.0f %6d %6d  %d..%d\n", name(s), r, want, got, decodeChords[c].lower, decodeChords[c].upper);
+				// integer model vs floating point, allow a count either way
+				if (got < want - 1 || got > want + 1) {
+					failed = 1;
+				}
+			} else {
+				printf("%-16s %6.0f %6d %6s  too close to another level\n", name(s), r, want, "-");
+			}
+		}
+	}
+	printf("%d of %d chords usable\n", decodeChordCount, DECODE_CHORDS);
+	return failed;
+}
+#endif
+
+static int check(void)
+{
+	int failed = 0;
+	int above = LADDER_IDLE_ADC - TOLLERANCE;
+
+	printf("%s: pull-up %d ohm, idle %lu ohm = %lu, tollerance %d\n",
+		LADDER_NAME, LADDER_PULLUP, (unsigned long)LADDER_IDLE, (unsigned long)LADDER_IDLE_ADC, TOLLERANCE);
+	printf("%-8s %6s %6s %6s %6s %7s\n", "button", "ohms", "centre", "lower", "upper", "margin");
+
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		int upper = centre[i] + TOLLERANCE;
+		int margin = above - upper - 1;
+
+		printf("%-8s %6lu %6u %6d %6d %7d%s\n", name(state[i]), ohms[i], centre[i],
+			(int)centre[i] - TOLLERANCE, upper, margin, margin < 0 ? "  OVERLAP" : "");
+		if (margin < 0) {
+			failed = 1;
+		}
+		above = (int)centre[i] - TOLLERANCE;
+	}
+
+#if OPT_CHORDS
+	failed |= checkChords();
+#endif
+
+	for (uint16_t adc = 0; adc < 1024; adc++) {
+		uint8_t got = DecodeAnalogue(adc);
+		if (got != expected(adc)) {
+			printf("adc %u decoded as %s, expected %s\n", adc, name(got), name(expected(adc)));
+			failed = 1;
+		}
+	}
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+static void vectors(void)
+{
+	printf("// %s test vectors: centre, window edges and just outside each window\n", LADDER_NAME);
+	printf("{%lu, VAL_IDLE},\n", (unsigned long)LADDER_IDLE_ADC);
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		int lower = (int)centre[i] - TOLLERANCE;
+		int upper = centre[i] + TOLLERANCE;
+		int adc[5] = {centre[i], lower, upper, lower - 1, upper + 1};
+
+		for (int j = 0; j < 5; j++) {
+			if (adc[j] >= 0 && adc[j] < 1024) {
+				uint8_t s = expected(adc[j]);
+				if (s >= VAL_CHORD) {
+					printf("{%d, VAL_CHORD + %d},\t// %s\n", adc[j], s - VAL_CHORD, name(s));
+				} else {
+					printf("{%d, VAL_%s},\n", adc[j], name(s));
+				}
+			}
+		}
+	}
+}
+
+static double nsPerDecode(const uint16_t *input, int count, long rounds)
+{
+	struct timespec start, end;
+	volatile uint8_t sink = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long r = 0; r < rounds; r++) {
+		for (int i = 0; i < count; i++) {
+			sink += DecodeAnalogue(input[i]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	(void)sink;
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((double)rounds * count);
+}
+
+static void benchmark(void)
+{
+	uint16_t sweep[1024], idle[1024];
+
+	for (int i = 0; i < 1024; i++) {
+		sweep[i] = i;
+		idle[i] = LADDER_IDLE_ADC;
+	}
+
+	// Idle is what the decoder sees nearly all the time and is the longest path
+	printf("decode, full sweep: %.2f ns\n", nsPerDecode(sweep, 1024, 20000));
+	printf("decode, idle:       %.2f ns\n", nsPerDecode(idle, 1024, 20000));
+}
+
+int main(int argc, char **argv)
+{
+	int failed;
+
+	decodeInit();
+	failed = check();
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		vectors();
+	}
+	benchmark();
+
+	return failed;
+}
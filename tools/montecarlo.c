@@ -0,0 +1,343 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Monte Carlo tolerance analysis of the decode windows.  Builds random installs - ladder and pull-up resistors
+within tolerance, a supply, an ADC with gain and offset error, a cabin temperature - reads every button and
+idle on each, and decodes the readings with the firmware's own DecodeAnalogue() against the selected
+profile's windows.  Runs on the host.
+
+	gcc -O2 -I. -o montecarlo tools/montecarlo.c decode.c -lm
+	./montecarlo [options]
+
+	-n trials	installs to build (default 1000000)
+	-t pct		ladder resistor tolerance (default 5)
+	-p pct		pull-up tolerance (default 1)
+	-v pct		7805 output tolerance (default 4); only matters with -x
+	-x pct		the ladder is fed from its own supply this far off Vcc (default 0, ratiometric: the pull-up
+				is on the same 5v as the ADC reference, so Vcc cancels)
+	-o lsb		ADC offset error (default 2)
+	-g lsb		ADC gain error at full scale (default 2)
+	-r lsb		ADC noise, standard deviation per reading (default 0.5)
+	-c lo hi	temperature range in C (default -40 85), from 25C
+	-k ppm		ladder resistor tempco in ppm/C (default 200, carbon film in the wheel)
+	-q ppm		pull-up tempco in ppm/C (default 100)
+	-s ohms		worst switch contact resistance, in series with a pressed button (default 2)
+	-u			uniform within tolerance instead of a normal distribution with tolerance at 3 sigma
+	-l			learnt windows: each install is calibrated at 25C first (OPT_CALIBRATE), so only drift
+				and noise are left.  Idle and each button are measured CAL_SAMPLES times as calibrate.c
+				does and get its half width (CAL_HALF_WIDTH, from the spread); an install whose windows
+				would touch keeps the profile's, as the firmware does.  That is CAL_SAMPLES readings per level
+				per install, so use a smaller -n
+	-m prob		fail (exit 1) if any button reads as a different button with more than this probability
+
+For each level it reports how often it decoded as something else, split into misses (read as idle, the
+press is lost) and false commands (read as another button), every pair that happened, and the worst case
+margin: how far inside its window the worst reading was, negative once it is outside.
+Build with -DVEHICLE=VEHICLE_xxx for another profile; chords (OPT_CHORDS) aren't modelled.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "decode.h"
+#include "calibrate.h"
+
+#define OHMS(state, ohms)		ohms,
+static const unsigned long ohms[] = { LADDER_BUTTONS(OHMS) };
+static const uint8_t states[] = { LADDER_BUTTONS(LADDER_STATE) };
+
+static const char *stateNames[VAL_CHORD] = {
+	"IDLE", "VOLUP", "VOLDN", "SRC", "SEEKFWD", "SEEKBK", "SOUND", "AUX1", "AUX2", "AUX3", "AUX4", "DIG1", "DIG2", "DIG3"
+};
+
+#define LEVELS			(DECODE_BUTTONS + 1)	// idle first, then the buttons
+#define ROOM_C			25.0
+
+struct mc_options {
+	unsigned long trials;
+	double tolR, tolP, tolVcc, tolSource;
+	double offset, gain, noise;
+	double tempLo, tempHi;
+	double tcR, tcP;
+	double contact;
+	int uniform;
+	int learnt;
+	double maxFalse;
+};
+typedef struct mc_options mcOptions;
+
+struct mc_level {
+	unsigned long wrong[VAL_STATES];	// decoded as each state, when it wasn't this one
+	unsigned long missed;				// buttons read as idle
+	unsigned long falseCommands;		// read as another button
+	double worstMargin;
+	double worstReading;
+};
+typedef struct mc_level mcLevel;
+
+static uint64_t rng = 0x853C49E6748FEA9BULL;
+
+static double uniform(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian(void)
+{
+	double u = uniform();
+
+	while (u <= 0) {
+		u = uniform();
+	}
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * uniform());
+}
+
+// A relative error within +-tol, uniform or normal with tol at 3 sigma (clipped there)
+static double spread(const mcOptions *o, double tol)
+{
+	double x;
+
+	if (o->uniform) {
+		return (2 * uniform() - 1) * tol;
+	}
+	x = gaussian() / 3;
+	if (x > 1) x = 1;
+	if (x < -1) x = -1;
+	return x * tol;
+}
+
+// One install: everything that is the same for every button on it
+struct mc_install {
+	double pullup;
+	double ladder[LEVELS];
+	double sourceRatio;		// ladder supply / ADC reference
+	double offset, gain;
+	double temp;
+};
+typedef struct mc_install mcInstall;
+
+static void build(const mcOptions *o, mcInstall *in)
+{
+	in->pullup = LADDER_PULLUP * (1 + spread(o, o->tolP));
+	for (int i = 0; i < LEVELS; i++) {
+		in->ladder[i] = (i ? ohms[i - 1] : LADDER_IDLE) * (1 + spread(o, o->tolR));
+	}
+	in->sourceRatio = o->tolSource ? (1 + spread(o, o->tolSource)) / (1 + spread(o, o->tolVcc)) : 1;
+	in->offset = spread(o, o->offset);
+	in->gain = spread(o, o->gain) / 1024;
+	in->temp = o->tempLo + uniform() * (o->tempHi - o->tempLo);
+}
+
+// ADC reading of a level on an install at a temperature, before noise
+static double level(const mcOptions *o, const mcInstall *in, int i, double temp, double contact)
+{
+	double dt = temp - ROOM_C;
+	double r = in->ladder[i] * (1 + o->tcR * 1e-6 * dt) + contact;
+	double rp = in->pullup * (1 + o->tcP * 1e-6 * dt);
+	double v = 1024.0 * r / (r + rp) * in->sourceRatio;
+
+	return v * (1 + in->gain) + in->offset;
+}
+
+static uint16_t convert(const mcOptions *o, double v)
+{
+	v += gaussian() * o->noise;
+	v = floor(v + 0.5);
+	return v < 0 ? 0 : v > 1023 ? 1023 : (uint16_t)v;
+}
+
+// calibrate.c's measure() on the bench: mean and half width of CAL_SAMPLES readings of a level
+static void learnLevel(const mcOptions *o, const mcInstall *in, int i, uint16_t *mean, uint16_t *tol)
+{
+	double v = level(o, in, i, ROOM_C, i ? o->contact / 2 : 0);
+	uint32_t sum = 0;
+	uint16_t min = 0xFFFF, max = 0;
+
+	for (int k = 0; k < CAL_SAMPLES; k++) {
+		uint16_t adc = convert(o, v);
+
+		sum += adc;
+		if (adc < min) min = adc;
+		if (adc > max) max = adc;
+	}
+	*mean = sum / CAL_SAMPLES;
+	*tol = CAL_HALF_WIDTH(max - min > 0xFF ? 0xFF : max - min);
+}
+
+// Learnt windows, or the profile's if they would touch (calibrate.c valid()); returns 0 for the profile's
+static int learn(const mcOptions *o, const mcInstall *in)
+{
+	uint16_t mean[LEVELS], tol[LEVELS];
+	int limit, ok = 1;
+
+	for (int i = 0; i < LEVELS; i++) {
+		learnLevel(o, in, i, &mean[i], &tol[i]);
+	}
+	limit = mean[0] - tol[0];
+	for (int i = 1; i < LEVELS && ok; i++) {
+		ok = mean[i] + tol[i] < limit;
+		limit = mean[i] - tol[i];
+	}
+	for (int i = 0; i < DECODE_BUTTONS; i++) {
+		if (ok) {
+			decodeSetWindow(i, mean[i + 1], tol[i + 1]);
+		} else {
+			decodeSetWindow(i, decodeDefaultCentre(i), TOLLERANCE);
+		}
+	}
+	decodeBuild();
+	return ok;
+}
+
+// How far inside its own window a reading is; idle has no window, it is inside while clear of every button
+static double margin(int i, double v)
+{
+	if (i) {
+		const decodeWindow *w = &decodeTable[i - 1];
+		double in = v - w->lower < w->upper - v ? v - w->lower : w->upper - v;
+		return in;
+	}
+	return v - decodeTable[0].upper - 1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: montecarlo [-n trials] [-t pct] [-p pct] [-v pct] [-x pct] [-o lsb] [-g lsb] [-r lsb]\n"
+		"                  [-c lo hi] [-k ppm] [-q ppm] [-s ohms] [-u] [-l] [-m prob]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	mcOptions o = {1000000, 0.05, 0.01, 0.04, 0, 2, 2, 0.5, -40, 85, 200, 100, 2, 0, 0, -1};
+	mcLevel lv[LEVELS];
+	double worstFalse = 0, worstMargin = 1e9;
+	int failed = 0, pairs = 0, worstLevel = 0;
+	unsigned long rejected = 0;
+
+	for (int i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		int more = i + 1 < argc;
+
+		if (strcmp(a, "-u") == 0) o.uniform = 1;
+		else if (strcmp(a, "-l") == 0) o.learnt = 1;
+		else if (!more) usage();
+		else if (strcmp(a, "-n") == 0) o.trials = strtoul(argv[++i], NULL, 0);
+		else if (strcmp(a, "-t") == 0) o.tolR = atof(argv[++i]) / 100;
+		else if (strcmp(a, "-p") == 0) o.tolP = atof(argv[++i]) / 100;
+		else if (strcmp(a, "-v") == 0) o.tolVcc = atof(argv[++i]) / 100;
+		else if (strcmp(a, "-x") == 0) o.tolSource = atof(argv[++i]) / 100;
+		else if (strcmp(a, "-o") == 0) o.offset = atof(argv[++i]);
+		else if (strcmp(a, "-g") == 0) o.gain = atof(argv[++i]);
+		else if (strcmp(a, "-r") == 0) o.noise = atof(argv[++i]);
+		else if (strcmp(a, "-k") == 0) o.tcR = atof(argv[++i]);
+		else if (strcmp(a, "-q") == 0) o.tcP = atof(argv[++i]);
+		else if (strcmp(a, "-s") == 0) o.contact = atof(argv[++i]);
+		else if (strcmp(a, "-m") == 0) o.maxFalse = atof(argv[++i]);
+		else if (strcmp(a, "-c") == 0 && i + 2 < argc) {
+			o.tempLo = atof(argv[++i]);
+			o.tempHi = atof(argv[++i]);
+		} else usage();
+	}
+	if (!o.trials) {
+		usage();
+	}
+
+	decodeInit();
+	memset(lv, 0, sizeof(lv));
+	for (int i = 0; i < LEVELS; i++) {
+		lv[i].worstMargin = 1e9;
+	}
+
+	for (unsigned long t = 0; t < o.trials; t++) {
+		mcInstall in;
+
+		build(&o, &in);
+		// calibrate.c learns each level at whatever the install is like on the bench
+		if (o.learnt && !learn(&o, &in)) {
+			rejected++;
+		}
+
+		for (int i = 0; i < LEVELS; i++) {
+			double contact = i ? uniform() * o.contact : 0;
+			double v = level(&o, &in, i, in.temp, contact);
+			uint16_t adc = convert(&o, v);
+			uint8_t want = i ? states[i - 1] : VAL_IDLE;
+			uint8_t got = DecodeAnalogue(adc);
+			double m = margin(i, adc);
+
+			if (m < lv[i].worstMargin) {
+				lv[i].worstMargin = m;
+				lv[i].worstReading = v;
+			}
+			if (got != want) {
+				lv[i].wrong[got]++;
+				if (got == VAL_IDLE) {
+					lv[i].missed++;
+				} else {
+					lv[i].falseCommands++;
+				}
+			}
+		}
+	}
+
+	printf("%s, %lu installs: %.1f%% ladder, %.1f%% pull-up, %s, ADC %.1f offset %.1f gain %.1f noise (lsb),\n"
+		"%.0f..%.0fC at %.0f/%.0f ppm/C, %.1f ohm contacts, %s, ", LADDER_NAME, o.trials,
+		o.tolR * 100, o.tolP * 100, o.tolSource ? "separate ladder supply" : "ratiometric", o.offset, o.gain,
+		o.noise, o.tempLo, o.tempHi, o.tcR, o.tcP, o.contact, o.uniform ? "uniform" : "normal, tolerance = 3 sigma");
+	if (o.learnt) {
+		printf("learnt windows +-%d..%d (%lu installs kept the profile's)\n\n", CAL_MIN_TOLLERANCE, TOLLERANCE,
+			rejected);
+	} else {
+		printf("profile windows +-%d\n\n", TOLLERANCE);
+	}
+
+	// worst is the reading before noise that came closest to leaving its window
+	printf("%-8s %8s %8s %12s %12s  %s\n", "level", "centre", "worst", "P(miss)", "P(false)", "margin");
+	for (int i = 0; i < LEVELS; i++) {
+		uint8_t want = i ? states[i - 1] : VAL_IDLE;
+		double pMiss = (double)lv[i].missed / o.trials;
+		double pFalse = (double)lv[i].falseCommands / o.trials;
+
+		printf("%-8s %8u %8.1f %12.3g %12.3g  %.1f\n", stateNames[want],
+			i ? decodeDefaultCentre(i - 1) : (unsigned)LADDER_IDLE_ADC, lv[i].worstReading, pMiss, pFalse, lv[i].worstMargin);
+		if (pFalse > worstFalse) {
+			worstFalse = pFalse;
+		}
+		if (lv[i].worstMargin < worstMargin) {
+			worstMargin = lv[i].worstMargin;
+			worstLevel = want;
+		}
+	}
+	printf("worst case margin %.1f counts (%s)\n", worstMargin, stateNames[worstLevel]);
+
+	printf("\nmisdecodes by pair:\n");
+	for (int i = 0; i < LEVELS; i++) {
+		uint8_t want = i ? states[i - 1] : VAL_IDLE;
+
+		for (int s = 0; s < VAL_STATES; s++) {
+			if (lv[i].wrong[s]) {
+				printf("  %-8s as %-8s %12.3g\n", stateNames[want], s < VAL_CHORD ? stateNames[s] : "chord",
+					(double)lv[i].wrong[s] / o.trials);
+				pairs++;
+			}
+		}
+	}
+	if (!pairs) {
+		printf("  none\n");
+	}
+
+	if (o.maxFalse >= 0 && worstFalse > o.maxFalse) {
+		printf("\nFAILED: a false command probability of %.3g is over %.3g\n", worstFalse, o.maxFalse);
+		failed = 1;
+	}
+	return failed;
+}
@@ -0,0 +1,349 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Trace replay.  Runs recorded ADC traces (tools/trace.h) through the firmware's own decode, debounce and
+keymap code on the host and scores the result.
+
+	gcc -O2 -DF_CPU=8000000UL -I. -o replay tools/replay.c tools/trace.c decode.c debounce.c keymap.c
+	./replay [-v] [-m max] trace...		replay and report, all traces added together
+	./replay -c in.csv out.trc			convert a "tick,adc[,state]" CSV log to a trace
+
+Each sample is one tick, run the way the firmware runs it: the tick ISR debounces the previous sample's
+decoded state, main() reads it back and dispatches through the keymap, then the sample is decoded for the
+next tick.  The transmitter is modelled as busy for the length of each command's frames, with commands
+sent in the order they are queued (priorities aren't modelled), and the keymap sees it busy just as it does
+on the chip.
+
+With truth marks in the trace it reports
+	false positives		debounced presses of a state the driver wasn't holding (phantom if nothing was held)
+	missed				presses the driver made that never came out debounced
+	latency				ticks from the driver's press to its command starting on the wire, as a histogram
+-v lists every debounce transition, command and truth mark.  -m fails (exit 1) if false positives plus
+missed presses come to more than max, so a corpus of traces can be kept as a regression test.
+Build with the same -D options as the firmware (e.g. -DVEHICLE=..., -DOPT_CHORDS=1) to replay that build;
+with -DOPT_ADAPTIVE_DEBOUNCE=1, -v also shows the debounce target moving.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "decode.h"
+#include "debounce.h"
+#include "keymap.h"
+#include "timing.h"
+#include "tools/trace.h"
+
+#define LATENCY_BUCKETS	48		// one per tick, the last one is everything longer
+#if OPT_ADAPTIVE_DEBOUNCE
+#define TRUTH_SLACK		(DEBOUNCE_MAX_TICKS + 2)	// how long after the driver lets go a press can still come out
+#else
+#define TRUTH_SLACK		(DEBOUNCE_TICKS + 2)
+#endif
+
+struct replay_stats {
+	uint32_t ticks;
+	uint32_t presses;			// debounced presses
+	uint32_t commands;
+	uint32_t phantom;			// false positives with nothing held
+	uint32_t misdecoded;		// false positives with another state held
+	uint32_t truthPresses;
+	uint32_t missed;
+	uint32_t latency[LATENCY_BUCKETS];
+	uint32_t latencySum;
+	uint32_t latencyCount;
+	uint8_t scored;				// any truth marks seen
+};
+typedef struct replay_stats replayStats;
+
+// the firmware's debounce reads this to tell ISR calls (counting) from main() calls (reading back)
+volatile unsigned char tick;
+
+static const char *stateNames[VAL_CHORD] = {
+	"IDLE", "VOLUP", "VOLDN", "SRC", "SEEKFWD", "SEEKBK", "SOUND", "AUX1", "AUX2", "AUX3", "AUX4",
+	"DIG1", "DIG2", "DIG3"
+};
+
+static const char *name(uint8_t s)
+{
+	static char buf[16];
+
+	if (s < VAL_CHORD) {
+		return stateNames[s];
+	}
+	snprintf(buf, sizeof(buf), "CHORD%d", s - VAL_CHORD);
+	return buf;
+}
+
+static double ms(uint32_t ticks)
+{
+	return ticks * (TICK_ACTUAL_NS / 1e6);
+}
+
+// Ticks the transmitter is busy for one command, worked out the way jvc.c lays out a frame
+static uint32_t commandTicks(uint8_t cmd)
+{
+	uint32_t bits = ((1UL << HU_START_BITS) - 1)
+		| (uint32_t)(HU_ADDRESS & ((1U << HU_ADDRESS_BITS) - 1)) << HU_START_BITS
+		| (uint32_t)(cmd & ((1U << HU_COMMAND_BITS) - 1)) << (HU_START_BITS + HU_ADDRESS_BITS)
+		| ((1UL << HU_STOP_BITS) - 1) << (HU_START_BITS + HU_ADDRESS_BITS + HU_COMMAND_BITS);
+	uint32_t ticks = HU_RESET_TICKS + HU_LEAD_LOW_TICKS + HU_LEAD_HIGH_TICKS;
+	int ones = 0;
+
+	// bit order doesn't change the length, only the count of ones
+	for (int i = 0; i < HU_BITS; i++) {
+		ones += (bits >> i) & 1;
+	}
+	ticks += HU_BITS * HU_MARK_TICKS + ones * HU_SPACE1_TICKS + (HU_BITS - ones) * HU_SPACE0_TICKS;
+	return ticks * HU_FRAMES;
+}
+
+static int replay(const char *path, replayStats *s, int verbose)
+{
+	traceFile t;
+	traceRecord r;
+	debounceData deb;
+	uint8_t decoded = VAL_IDLE, state, lastState = VAL_IDLE, code;
+#if OPT_ADAPTIVE_DEBOUNCE
+	debounceNoise noise;
+	uint16_t reading = LADDER_IDLE_ADC;
+	unsigned long target = DEBOUNCE_TICKS;
+#endif
+	uint8_t truth = VAL_IDLE;
+	uint32_t now = 0, busy = 0, lastTruth[VAL_STATES];
+	int first = 1;
+
+	// the press being scored: the driver's latest, until the next one
+	uint8_t pressState = VAL_IDLE, pressSeen = 0, pressTimed = 0;
+	uint32_t pressTick = 0;
+
+	if (!traceOpenRead(&t, path)) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		return 0;
+	}
+	if (t.tickNs != TICK_NS) {
+		fprintf(stderr, "%s: recorded at %lu ns a sample, replaying as one tick (%lu ns) each\n",
+			path, (unsigned long)t.tickNs, (unsigned long)TICK_NS);
+	}
+
+	decodeInit();
+	initDebounce(&deb, DEBOUNCE_TICKS, VAL_IDLE, 0);
+#if OPT_ADAPTIVE_DEBOUNCE
+	initDebounceNoise(&noise);
+#endif
+	keymapReset();
+	memset(lastTruth, 0xFF, sizeof(lastTruth));
+
+	while (traceRead(&t, &r)) {
+		if (r.type == TRACE_MARK) {
+			s->scored = 1;
+			if (r.value >= VAL_STATES) {
+				r.value = VAL_IDLE;
+			}
+			if (r.value != truth && r.value != VAL_IDLE) {
+				if (pressState != VAL_IDLE && !pressSeen) {
+					s->missed++;
+				}
+				pressState = r.value;
+				pressTick = now;
+				pressSeen = pressTimed = 0;
+				s->truthPresses++;
+			}
+			truth = r.value;
+			if (verbose) {
+				printf("%8lu %10.1fms  truth    %s\n", (unsigned long)now, ms(now), name(truth));
+			}
+			continue;
+		}
+
+		// a gap in the trace holds the previous reading
+		for (uint8_t step = first ? 1 : r.delta; step > 0; step--) {
+			uint16_t adc = step == 1 ? r.value : 0xFFFF;
+
+			now++;
+			s->ticks++;
+			lastTruth[truth] = now;
+
+			// tick ISR, then main() reading back
+			tick = 1;
+			state = getDebounced(&deb, decoded);
+#if OPT_ADAPTIVE_DEBOUNCE
+			debounceAdapt(&deb, &noise, reading, decoded);
+			if (deb.debounceTarget != target) {
+				if (verbose) {
+					printf("%8lu %10.1fms  target   %lu -> %lu ticks\n", (unsigned long)now, ms(now), target,
+						deb.debounceTarget);
+				}
+				target = deb.debounceTarget;
+			}
+#endif
+			tick = 0;
+			state = getDebounced(&deb, decoded);
+
+			if (state != lastState) {
+				if (verbose) {
+					printf("%8lu %10.1fms  debounce %s -> %s\n", (unsigned long)now, ms(now), name(lastState), name(state));
+				}
+				if (state != VAL_IDLE) {
+					s->presses++;
+					if (s->scored && (lastTruth[state] == 0xFFFFFFFFUL || now - lastTruth[state] > TRUTH_SLACK)) {
+						if (truth == VAL_IDLE) {
+							s->phantom++;
+						} else {
+							s->misdecoded++;
+						}
+					}
+					if (state == pressState) {
+						pressSeen = 1;
+					}
+				}
+				lastState = state;
+			}
+
+			code = keymapDispatch(state, busy == 0);
+			if (code != KEY_NONE) {
+				uint32_t start = now + busy;
+
+				s->commands++;
+				if (verbose) {
+					printf("%8lu %10.1fms  command  0x%02X%s, on the wire at %.1fms\n", (unsigned long)now, ms(now),
+						code, keymapRepeating() ? " (repeat)" : "", ms(start));
+				}
+				if (state == pressState && pressSeen && !pressTimed && !keymapRepeating()) {
+					uint32_t latency = start - pressTick;
+					s->latency[latency < LATENCY_BUCKETS ? latency : LATENCY_BUCKETS - 1]++;
+					s->latencySum += latency;
+					s->latencyCount++;
+					pressTimed = 1;
+				}
+				busy += commandTicks(code);
+			}
+			if (busy) {
+				busy--;
+			}
+
+			// ADC interrupt, for the next tick
+			if (adc != 0xFFFF) {
+				decoded = DecodeAnalogue(adc);
+#if OPT_ADAPTIVE_DEBOUNCE
+				reading = adc;
+#endif
+			}
+		}
+		first = 0;
+	}
+	if (pressState != VAL_IDLE && !pressSeen) {
+		s->missed++;
+	}
+
+	traceClose(&t);
+	return 1;
+}
+
+static void report(const replayStats *s)
+{
+	uint32_t most = 1;
+
+	printf("%lu ticks (%.1fs), %lu presses, %lu commands\n", (unsigned long)s->ticks, ms(s->ticks) / 1000,
+		(unsigned long)s->presses, (unsigned long)s->commands);
+	if (!s->scored) {
+		printf("no truth marks, nothing to score\n");
+		return;
+	}
+	printf("driver presses %lu, missed %lu\n", (unsigned long)s->truthPresses, (unsigned long)s->missed);
+	printf("false positives %lu (phantom %lu, misdecoded %lu)\n", (unsigned long)(s->phantom + s->misdecoded),
+		(unsigned long)s->phantom, (unsigned long)s->misdecoded);
+
+	if (!s->latencyCount) {
+		return;
+	}
+	printf("press to command latency, mean %.2fms\n", ms(s->latencySum) / s->latencyCount);
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		if (s->latency[i] > most) {
+			most = s->latency[i];
+		}
+	}
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		if (s->latency[i]) {
+			int bar = (int)(s->latency[i] * 50 / most);
+			printf("%s%3d ticks %6.1fms %6lu %.*s\n", i == LATENCY_BUCKETS - 1 ? ">=" : "  ", i, ms(i),
+				(unsigned long)s->latency[i], bar ? bar : 1, "##################################################");
+		}
+	}
+}
+
+static int convert(const char *in, const char *out)
+{
+	FILE *f = fopen(in, "r");
+	traceFile t;
+	char line[128];
+	long prevTick = -1, tickNo;
+	int adc, state, truth = -1, fields;
+
+	if (!f || !traceOpenWrite(&t, out, TICK_NS)) {
+		fprintf(stderr, "can't open %s or %s\n", in, out);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		fields = sscanf(line, "%ld,%d,%d", &tickNo, &adc, &state);
+		if (fields < 2 || tickNo <= prevTick || adc < 0 || adc > 1023) {
+			fprintf(stderr, "bad line: %s", line);
+			continue;
+		}
+		if (fields == 3 && state != truth) {
+			traceWriteMark(&t, state);
+			truth = state;
+		}
+		traceWriteSample(&t, adc, prevTick < 0 ? 1 : tickNo - prevTick);
+		prevTick = tickNo;
+	}
+	fclose(f);
+	traceClose(&t);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	replayStats stats;
+	int verbose = 0, i = 1;
+	long maxBad = -1;
+	clock_t start;
+
+	if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+		return convert(argv[2], argv[3]);
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-v") == 0) {
+			verbose = 1;
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			maxBad = atol(argv[++i]);
+		}
+	}
+	if (i >= argc) {
+		fprintf(stderr, "usage: replay [-v] [-m max] trace...\n       replay -c in.csv out.trc\n");
+		return 2;
+	}
+	start = clock();
+	for (; i < argc; i++) {
+		if (!replay(argv[i], &stats, verbose)) {
+			return 2;
+		}
+	}
+
+	report(&stats);
+	printf("replayed at %.1fM ticks/s\n", stats.ticks / 1e6 / ((double)(clock() - start) / CLOCKS_PER_SEC + 1e-9));
+	if (maxBad >= 0 && stats.phantom + stats.misdecoded + stats.missed > (uint32_t)maxBad) {
+		printf("FAILED: more than %ld false positives and missed presses\n", maxBad);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,301 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Static stack report.  Reads the call graphs GCC writes with -fcallgraph-info=su, which carry each function's
+frame as -fstack-usage works it out, and gives the deepest call chain from main() and from each interrupt
+vector.  Runs on the host.
+
+	avr-gcc -mmcu=attiny85 -Os -DF_CPU=8000000UL -fstack-usage -fcallgraph-info=su -c *.c
+	gcc -O2 -o stackuse tools/stackuse.c
+	./stackuse [-v] [-s bytes] *.ci
+
+	-v			every function with its own frame and its deepest chain
+	-s bytes	SRAM left for the stack, 512 less .data, .bss and .noinit (avr-size); fails (exit 1) if the
+				worst case doesn't fit
+
+Build the objects with the same -D options as the firmware.  avr-gcc's frame figures include the return
+address and the registers saved in the prologue, so a chain is the sum of its frames.  Interrupts don't nest
+(no ISR re-enables them), so the worst case is main()'s deepest chain with the deepest vector on top of it.
+Functions with no figure (avr-libc assembler such as the eeprom_* routines) are counted as UNKNOWN_BYTES
+and listed; recursion and dynamic frames (alloca, variable length arrays) are reported as unbounded.
+Compare against OPT_STACKMON's measured peak (stackmon.h) - the static figure should never be lower.
+
+tools/fixtures/recursion.ci is main() calling f() and g() that call each other (gcc -fcallgraph-info=su);
+run after changing the walk, it has to come out unbounded and exit 1:
+
+	./stackuse -s 400 tools/fixtures/recursion.ci
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FUNCS		1024
+#define MAX_EDGES		4096
+#define MAX_NAME		128
+#define UNKNOWN_BYTES	2		// return address only
+
+struct stack_func {
+	char name[MAX_NAME];	// as GCC titles it, "file.c:name" for static functions
+	int frame;				// bytes, -1 if no object had a figure for it
+	int dynamic;			// frame isn't a fixed size
+	int worst;				// deepest chain from here, -1 not worked out yet
+	int next;				// callee on the deepest chain, -1 for none
+	int visiting;
+	int unbounded;			// recursion or a dynamic frame somewhere below
+};
+typedef struct stack_func stackFunc;
+
+struct stack_edge {
+	int from, to;
+};
+typedef struct stack_edge stackEdge;
+
+static stackFunc funcs[MAX_FUNCS];
+static int funcCount;
+static stackEdge edges[MAX_EDGES];
+static int edgeCount;
+
+static int findFunc(const char *name)
+{
+	for (int i = 0; i < funcCount; i++) {
+		if (strcmp(funcs[i].name, name) == 0) {
+			return i;
+		}
+	}
+	if (funcCount == MAX_FUNCS) {
+		fprintf(stderr, "more than %d functions\n", MAX_FUNCS);
+		exit(2);
+	}
+	snprintf(funcs[funcCount].name, MAX_NAME, "%s", name);
+	funcs[funcCount].frame = -1;
+	funcs[funcCount].worst = -1;
+	funcs[funcCount].next = -1;
+	return funcCount++;
+}
+
+// Copies the quoted value after key into out; returns a pointer past it or NULL
+static const char *quoted(const char *line, const char *key, char *out, size_t len)
+{
+	const char *p = strstr(line, key);
+	size_t n = 0;
+
+	if (!p) {
+		return NULL;
+	}
+	p += strlen(key);
+	while (*p == ' ' || *p == ':') {
+		p++;
+	}
+	if (*p++ != '"') {
+		return NULL;
+	}
+	while (*p && *p != '"') {
+		if (n + 1 < len) {
+			out[n++] = *p;
+		}
+		p++;
+	}
+	out[n] = 0;
+	return *p ? p + 1 : NULL;
+}
+
+static int readGraph(const char *path)
+{
+	FILE *in = fopen(path, "r");
+	char line[1024], title[MAX_NAME], label[512], target[MAX_NAME];
+
+	if (!in) {
+		perror(path);
+		return 0;
+	}
+	while (fgets(line, sizeof(line), in)) {
+		if (strncmp(line, "node:", 5) == 0) {
+			const char *bytes;
+
+			if (!quoted(line, "title", title, sizeof(title)) || !quoted(line, "label", label, sizeof(label))) {
+				continue;
+			}
+			// label is "name\nfile:line:col\nN bytes (static)" with a literal backslash n; calls only have two parts
+			bytes = strstr(label, " bytes (");
+			if (bytes) {
+				stackFunc *f = &funcs[findFunc(title)];
+
+				while (bytes > label && bytes[-1] >= '0' && bytes[-1] <= '9') {
+					bytes--;
+				}
+				f->frame = atoi(bytes);
+				f->dynamic = strstr(bytes, "(static)") == NULL;
+			} else {
+				findFunc(title);
+			}
+		} else if (strncmp(line, "edge:", 5) == 0) {
+			if (!quoted(line, "sourcename", title, sizeof(title))
+				|| !quoted(line, "targetname", target, sizeof(target))) {
+				continue;
+			}
+			if (edgeCount == MAX_EDGES) {
+				fprintf(stderr, "more than %d calls\n", MAX_EDGES);
+				exit(2);
+			}
+			edges[edgeCount].from = findFunc(title);
+			edges[edgeCount].to = findFunc(target);
+			edgeCount++;
+		}
+	}
+	fclose(in);
+	return 1;
+}
+
+static int frameOf(const stackFunc *f)
+{
+	return f->frame < 0 ? UNKNOWN_BYTES : f->frame;
+}
+
+static int walk(int i)
+{
+	stackFunc *f = &funcs[i];
+	int worst = 0;
+
+	if (f->visiting) {
+		// a call back into the chain being walked
+		f->unbounded = 1;
+		return 0;
+	}
+	if (f->worst >= 0) {
+		return f->worst;
+	}
+	f->visiting = 1;
+	f->unbounded = f->dynamic;
+	for (int e = 0; e < edgeCount; e++) {
+		if (edges[e].from == i) {
+			int to = edges[e].to;
+			int backEdge = funcs[to].visiting;
+			int below = walk(to);
+
+			if (funcs[to].unbounded) {
+				f->unbounded = 1;
+			}
+			// the chain stops at a call back up it, so printChain() ends
+			if (!backEdge && (below > worst || f->next < 0)) {
+				worst = below;
+				f->next = to;
+			}
+		}
+	}
+	// worst stays -1 until here, so a call back into f while its callees are walked is seen as one
+	f->worst = worst + frameOf(f);
+	f->visiting = 0;
+	return f->worst;
+}
+
+static const char *shortName(const char *name)
+{
+	const char *colon = strrchr(name, ':');
+	return colon ? colon + 1 : name;
+}
+
+static void printChain(int i)
+{
+	for (; i >= 0; i = funcs[i].next) {
+		printf("%s(%d)%s", shortName(funcs[i].name), frameOf(&funcs[i]), funcs[i].next >= 0 ? " > " : "\n");
+	}
+}
+
+static int isVector(const char *name)
+{
+	size_t len = strlen(name);
+	return strncmp(shortName(name), "__vector_", 9) == 0 || (len > 5 && strcmp(name + len - 5, "_vect") == 0);
+}
+
+int main(int argc, char **argv)
+{
+	int verbose = 0, sram = -1, files = 0;
+	int mainFunc = -1, worstVector = -1, unbounded = 0, unknown = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-v") == 0) {
+			verbose = 1;
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			sram = atoi(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: stackuse [-v] [-s bytes] file.ci...\n");
+			return 2;
+		} else {
+			if (!readGraph(argv[i])) {
+				return 2;
+			}
+			files++;
+		}
+	}
+	if (!files) {
+		fprintf(stderr, "usage: stackuse [-v] [-s bytes] file.ci...\n");
+		return 2;
+	}
+
+	for (int i = 0; i < funcCount; i++) {
+		walk(i);
+		if (strcmp(funcs[i].name, "main") == 0) {
+			mainFunc = i;
+		} else if (isVector(funcs[i].name) && (worstVector < 0 || funcs[i].worst > funcs[worstVector].worst)) {
+			worstVector = i;
+		}
+	}
+
+	if (verbose) {
+		printf("%-32s %6s %6s\n", "function", "frame", "worst");
+		for (int i = 0; i < funcCount; i++) {
+			char frame[16] = "?";
+
+			if (funcs[i].frame >= 0) {
+				snprintf(frame, sizeof(frame), "%d%s", funcs[i].frame, funcs[i].dynamic ? "+" : "");
+			}
+			printf("%-32s %6s %6d%s\n", funcs[i].name, frame, funcs[i].worst, funcs[i].unbounded ? " unbounded" : "");
+		}
+		printf("\n");
+	}
+
+	for (int i = 0; i < funcCount; i++) {
+		if (funcs[i].frame < 0) {
+			if (!unknown++) {
+				printf("no figure, counted as %d bytes:", UNKNOWN_BYTES);
+			}
+			printf(" %s", funcs[i].name);
+		}
+	}
+	if (unknown) {
+		printf("\n");
+	}
+
+	if (mainFunc < 0) {
+		fprintf(stderr, "no main() in the call graphs\n");
+		return 2;
+	}
+	printf("deepest chains, bytes (frame):\n");
+	printf("  main      %4d: ", funcs[mainFunc].worst);
+	printChain(mainFunc);
+	unbounded |= funcs[mainFunc].unbounded;
+	for (int i = 0; i < funcCount; i++) {
+		if (isVector(funcs[i].name)) {
+			printf("  interrupt %4d: ", funcs[i].worst);
+			printChain(i);
+			unbounded |= funcs[i].unbounded;
+		}
+	}
+
+	int total = funcs[mainFunc].worst + (worstVector >= 0 ? funcs[worstVector].worst : 0);
+	printf("worst case %d bytes: main with %s on top%s\n", total,
+		worstVector >= 0 ? shortName(funcs[worstVector].name) : "no interrupt",
+		unbounded ? ", unbounded (recursion or a dynamic frame)" : "");
+	if (sram >= 0) {
+		printf("headroom %d bytes of %d\n", sram - total, sram);
+		if (total > sram || unbounded) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,481 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Debounce / tolerance sweep.  Runs the firmware's decode and debounce over synthetic wheel noise (and any
+recorded traces, tools/trace.h) for every combination of
+
+	debounce	0..SWEEP_MAX_DEBOUNCE samples
+	tolerance	window half width, SWEEP_MIN_TOL..SWEEP_MAX_TOL counts (combinations whose windows touch are skipped)
+	filter		none, median of the last 3 readings, mean of the last 2
+	interval	sample every 1..SWEEP_MAX_INTERVAL ticks
+
+and prints the Pareto front of mean press latency, worst press latency and error rate, the configurations
+no other one beats on all three.  The shipped one (DEBOUNCE_TICKS, TOLLERANCE, no filter, every tick) is
+marked with a *.
+
+	gcc -O2 -DF_CPU=8000000UL -I. -o sweep tools/sweep.c tools/trace.c decode.c debounce.c -lm
+	./sweep [-a] [-n model] [-p presses] [-s seed] [trace...]
+
+	-a			print every configuration, not just the front
+	-n model	only that noise model (clean, ripple, spikes, bounce, slew, car), or "none" for traces only
+	-p presses	presses per noise model (default 200)
+	-s seed		for the noise generator, so runs can be repeated
+
+Noise models, all on top of +-2 counts of ADC noise:
+	ripple		alternator ripple, SWEEP_RIPPLE counts, aliased down to a few ticks a cycle
+	spikes		ignition, a reading anywhere on the scale about once every SWEEP_SPIKE_GAP ticks
+	bounce		up to SWEEP_BOUNCE ticks of contact bounce on every press and release
+	slew		the line ramps between levels over up to SWEEP_SLEW ticks, through other buttons' windows
+	car			all of the above
+
+Errors are false presses (a debounced state the driver wasn't holding), missed presses and double presses
+(one press coming out as two), counted per 1000 real presses.  Latency is from the driver's press to the
+debounced state, in ms; the transmitter adds the same to every configuration so it's left out (replay.c
+measures the whole path).  Build with -DVEHICLE=VEHICLE_xxx to sweep another profile.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "decode.h"
+#include "debounce.h"
+#include "timing.h"
+#include "tools/trace.h"
+
+#define SWEEP_MAX_DEBOUNCE	12
+#define SWEEP_MIN_TOL		10
+#define SWEEP_MAX_TOL		60
+#define SWEEP_TOL_STEP		5
+#define SWEEP_MAX_INTERVAL	4
+
+#define SWEEP_RIPPLE		12
+#define SWEEP_SPIKE_GAP		300
+#define SWEEP_BOUNCE		10
+#define SWEEP_SLEW			15
+
+enum {FILTER_NONE, FILTER_MEDIAN3, FILTER_MEAN2, FILTERS};
+static const char *filterNames[FILTERS] = {"none", "median3", "mean2"};
+
+enum {NOISE_CLEAN, NOISE_RIPPLE, NOISE_SPIKES, NOISE_BOUNCE, NOISE_SLEW, NOISE_CAR, NOISE_MODELS};
+static const char *noiseNames[NOISE_MODELS] = {"clean", "ripple", "spikes", "bounce", "slew", "car"};
+#define NOISE_BIT(n)	(1 << (n))
+
+struct sweep_data {
+	const char *name;
+	uint16_t *adc;
+	uint8_t *truth;
+	uint32_t ticks;
+	uint32_t presses;
+};
+typedef struct sweep_data sweepData;
+
+struct sweep_config {
+	uint8_t debounce;		// samples
+	uint8_t tol;
+	uint8_t filter;
+	uint8_t interval;		// ticks per sample
+};
+typedef struct sweep_config sweepConfig;
+
+struct sweep_result {
+	sweepConfig cfg;
+	double meanMs;
+	double worstMs;
+	double errors;			// per 1000 presses
+	uint32_t falsePresses, missed, doubled;
+	uint8_t front;
+};
+typedef struct sweep_result sweepResult;
+
+// the firmware's debounce reads this to tell ISR calls (counting) from main() calls (reading back)
+volatile unsigned char tick;
+
+static uint32_t rng = 1;
+
+static uint32_t rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static int range(int lo, int hi)
+{
+	return lo + (int)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+static double ms(double ticks)
+{
+	return ticks * (TICK_ACTUAL_NS / 1e6);
+}
+
+static void grow(sweepData *d, uint32_t *size)
+{
+	if (d->ticks < *size) {
+		return;
+	}
+	*size = *size ? *size * 2 : 65536;
+	d->adc = realloc(d->adc, *size * sizeof(*d->adc));
+	d->truth = realloc(d->truth, *size);
+	if (!d->adc || !d->truth) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+}
+
+static void put(sweepData *d, uint32_t *size, int adc, uint8_t truth)
+{
+	grow(d, size);
+	d->adc[d->ticks] = adc < 0 ? 0 : adc > 1023 ? 1023 : adc;
+	d->truth[d->ticks] = truth;
+	d->ticks++;
+}
+
+// Move the line from one level to another the way the model says a contact does
+static void transition(sweepData *d, uint32_t *size, int from, int to, uint8_t truth, int noise)
+{
+	if (noise & NOISE_BIT(NOISE_BOUNCE)) {
+		for (int i = range(0, SWEEP_BOUNCE); i > 0; i--) {
+			int r = range(0, 2);
+			put(d, size, r == 0 ? from : r == 1 ? to : range(to < from ? to : from, to < from ? from : to), truth);
+		}
+	}
+	if (noise & NOISE_BIT(NOISE_SLEW)) {
+		int steps = range(1, SWEEP_SLEW);
+		for (int i = 1; i < steps; i++) {
+			put(d, size, from + (to - from) * i / steps, truth);
+		}
+	}
+}
+
+// Presses of random buttons for random lengths with idle gaps, every reading then run through the model
+static void synthesise(sweepData *d, int model, uint32_t presses)
+{
+	int noise = model == NOISE_CAR ? 0xFF : NOISE_BIT(model);
+	double phase = 0, step = 2 * M_PI / (2.0 + (rnd() % 1000) / 200.0);
+	uint32_t size = 0;
+	int idle = LADDER_IDLE_ADC, spike = 0;
+
+	memset(d, 0, sizeof(*d));
+	d->name = noiseNames[model];
+	d->presses = presses;
+
+	for (uint32_t p = 0; p < presses; p++) {
+		int button = range(0, DECODE_BUTTONS - 1);
+		int level = decodeDefaultCentre(button);
+		uint8_t state = decodeTable[button].state;
+
+		for (int i = range(100, 400); i > 0; i--) {
+			put(d, &size, idle, VAL_IDLE);
+		}
+		transition(d, &size, idle, level, state, noise);
+		for (int i = range(30, 300); i > 0; i--) {
+			put(d, &size, level, state);
+		}
+		// truth goes back to idle as soon as the driver starts letting go
+		transition(d, &size, level, idle, VAL_IDLE, noise);
+	}
+	for (int i = 200; i > 0; i--) {
+		put(d, &size, idle, VAL_IDLE);
+	}
+
+	// noise on top of the levels
+	for (uint32_t t = 0; t < d->ticks; t++) {
+		int v = d->adc[t] + range(-2, 2);
+
+		if (noise & NOISE_BIT(NOISE_RIPPLE)) {
+			v += (int)lround(SWEEP_RIPPLE * sin(phase));
+			phase += step;
+		}
+		if (spike) {
+			// second tick of a long one
+			v = range(0, 1023);
+			spike--;
+		} else if ((noise & NOISE_BIT(NOISE_SPIKES)) && range(0, SWEEP_SPIKE_GAP - 1) == 0) {
+			v = range(0, 1023);
+			spike = range(0, 1);
+		}
+		d->adc[t] = v < 0 ? 0 : v > 1023 ? 1023 : v;
+	}
+}
+
+static int load(sweepData *d, const char *path)
+{
+	traceFile t;
+	traceRecord r;
+	uint32_t size = 0;
+	uint8_t truth = VAL_IDLE, marked = 0;
+	uint16_t last = LADDER_IDLE_ADC;
+
+	memset(d, 0, sizeof(*d));
+	d->name = path;
+	if (!traceOpenRead(&t, path)) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		return 0;
+	}
+	for (int first = 1; traceRead(&t, &r); ) {
+		if (r.type == TRACE_MARK) {
+			marked = 1;
+			if (r.value != truth && r.value != VAL_IDLE && r.value < VAL_STATES) {
+				d->presses++;
+			}
+			truth = r.value < VAL_STATES ? r.value : VAL_IDLE;
+			continue;
+		}
+		for (int i = first ? 0 : r.delta - 1; i > 0; i--) {
+			put(d, &size, last, truth);
+		}
+		put(d, &size, r.value, truth);
+		last = r.value;
+		first = 0;
+	}
+	traceClose(&t);
+	if (!marked || !d->presses) {
+		fprintf(stderr, "%s: no truth marks, can't be scored\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+static uint16_t filter(uint8_t type, uint16_t *hist, uint16_t adc)
+{
+	uint16_t a = hist[0], b = hist[1];
+
+	hist[1] = a;
+	hist[0] = adc;
+	switch (type) {
+		case FILTER_MEDIAN3:
+			if ((adc >= a) == (a >= b)) return a;
+			if ((a >= adc) == (adc >= b)) return adc;
+			return b;
+		case FILTER_MEAN2:
+			return (adc + a + 1) / 2;
+	}
+	return adc;
+}
+
+// Decode and debounce one data set the way the tick ISR does, with one sample of pipeline delay
+static void run(const sweepConfig *cfg, const sweepData *d, sweepResult *res, double *latencySum,
+	uint32_t *latencyCount, uint32_t *worst)
+{
+	debounceData deb;
+	uint16_t hist[2] = {LADDER_IDLE_ADC, LADDER_IDLE_ADC};
+	uint8_t decoded = VAL_IDLE, state, lastState = VAL_IDLE, truth = VAL_IDLE;
+	uint8_t pressState = VAL_IDLE, pressSeen = 0;
+	uint32_t pressTick = 0, lastTruth[VAL_STATES];
+	uint32_t slack = (uint32_t)(cfg->debounce + 2) * cfg->interval;
+
+	initDebounce(&deb, cfg->debounce, VAL_IDLE, 0);
+	memset(lastTruth, 0xFF, sizeof(lastTruth));
+
+	for (uint32_t t = 0; t < d->ticks; t++) {
+		if (d->truth[t] != truth) {
+			if (d->truth[t] != VAL_IDLE) {
+				if (pressState != VAL_IDLE && !pressSeen) {
+					res->missed++;
+				}
+				pressState = d->truth[t];
+				pressTick = t;
+				pressSeen = 0;
+			}
+			truth = d->truth[t];
+		}
+		lastTruth[truth] = t;
+
+		if (t % cfg->interval) {
+			continue;
+		}
+
+		tick = 1;
+		state = getDebounced(&deb, decoded);
+		tick = 0;
+		state = getDebounced(&deb, decoded);
+
+		if (state != lastState && state != VAL_IDLE) {
+			if (lastTruth[state] == 0xFFFFFFFFUL || t - lastTruth[state] > slack) {
+				res->falsePresses++;
+			} else if (state == pressState) {
+				if (pressSeen) {
+					res->doubled++;
+				} else {
+					uint32_t latency = t - pressTick;
+
+					*latencySum += latency;
+					(*latencyCount)++;
+					if (latency > *worst) {
+						*worst = latency;
+					}
+					pressSeen = 1;
+				}
+			}
+		}
+		lastState = state;
+
+		decoded = DecodeAnalogue(filter(cfg->filter, hist, d->adc[t]));
+	}
+	if (pressState != VAL_IDLE && !pressSeen) {
+		res->missed++;
+	}
+}
+
+// Windows must not touch each other, and the top one must stay clear of idle the way ladder.h checks it
+static int setTolerance(uint8_t tol)
+{
+	for (uint8_t i = 0; i < DECODE_BUTTONS; i++) {
+		uint16_t c = decodeDefaultCentre(i);
+
+		if (c + 2 * tol >= (uint16_t)LADDER_IDLE_ADC || (i && c + tol >= decodeDefaultCentre(i - 1) - tol)) {
+			return 0;
+		}
+	}
+	for (uint8_t i = 0; i < DECODE_BUTTONS; i++) {
+		decodeSetWindow(i, decodeDefaultCentre(i), tol);
+	}
+	decodeBuild();
+	return 1;
+}
+
+static int dominates(const sweepResult *a, const sweepResult *b)
+{
+	return a->errors <= b->errors && a->meanMs <= b->meanMs && a->worstMs <= b->worstMs
+		&& (a->errors < b->errors || a->meanMs < b->meanMs || a->worstMs < b->worstMs);
+}
+
+static int shipped(const sweepConfig *cfg)
+{
+	return cfg->debounce == DEBOUNCE_TICKS && cfg->tol == TOLLERANCE && cfg->filter == FILTER_NONE
+		&& cfg->interval == 1;
+}
+
+static int order(const void *a, const void *b)
+{
+	const sweepResult *x = a, *y = b;
+
+	if (x->errors != y->errors) return x->errors < y->errors ? -1 : 1;
+	if (x->meanMs != y->meanMs) return x->meanMs < y->meanMs ? -1 : 1;
+	return x->worstMs < y->worstMs ? -1 : x->worstMs > y->worstMs;
+}
+
+static void print(const sweepResult *r)
+{
+	printf("%c %4d %5.1fms %4d %-8s %5d  %7.2f %8.2f  %8.2f  %5lu %5lu %5lu\n", shipped(&r->cfg) ? '*' : ' ',
+		r->cfg.debounce, ms(r->cfg.debounce * r->cfg.interval), r->cfg.tol, filterNames[r->cfg.filter],
+		r->cfg.interval, r->meanMs, r->worstMs, r->errors, (unsigned long)r->falsePresses,
+		(unsigned long)r->missed, (unsigned long)r->doubled);
+}
+
+int main(int argc, char **argv)
+{
+	sweepData data[NOISE_MODELS + 64];
+	sweepResult *results;
+	int sets = 0, all = 0, count = 0, skipped = 0, front = 0, i;
+	int only = -1;
+	uint32_t presses = 200, totalPresses = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-a") == 0) {
+			all = 1;
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			i++;
+			only = NOISE_MODELS;
+			for (int m = 0; m < NOISE_MODELS; m++) {
+				if (strcmp(argv[i], noiseNames[m]) == 0) {
+					only = m;
+				}
+			}
+			if (only == NOISE_MODELS && strcmp(argv[i], "none") != 0) {
+				fprintf(stderr, "unknown noise model %s\n", argv[i]);
+				return 2;
+			}
+		} else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			presses = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			rng = strtoul(argv[++i], NULL, 0) | 1;
+		} else {
+			fprintf(stderr, "usage: sweep [-a] [-n model] [-p presses] [-s seed] [trace...]\n");
+			return 2;
+		}
+	}
+
+	decodeInit();
+	for (int m = 0; m < NOISE_MODELS; m++) {
+		if (only < 0 || only == m) {
+			synthesise(&data[sets++], m, presses);
+		}
+	}
+	for (; i < argc && sets < (int)(sizeof(data) / sizeof(data[0])); i++) {
+		if (load(&data[sets], argv[i])) {
+			sets++;
+		}
+	}
+	if (!sets) {
+		fprintf(stderr, "nothing to sweep\n");
+		return 2;
+	}
+
+	printf("%s, %d data sets:", LADDER_NAME, sets);
+	for (int s = 0; s < sets; s++) {
+		printf(" %s (%lu presses)", data[s].name, (unsigned long)data[s].presses);
+		totalPresses += data[s].presses;
+	}
+	printf("\n");
+
+	results = calloc((SWEEP_MAX_DEBOUNCE + 1) * ((SWEEP_MAX_TOL - SWEEP_MIN_TOL) / SWEEP_TOL_STEP + 1) * FILTERS
+		* SWEEP_MAX_INTERVAL, sizeof(*results));
+	for (uint8_t tol = SWEEP_MIN_TOL; tol <= SWEEP_MAX_TOL; tol += SWEEP_TOL_STEP) {
+		if (!setTolerance(tol)) {
+			skipped += (SWEEP_MAX_DEBOUNCE + 1) * FILTERS * SWEEP_MAX_INTERVAL;
+			continue;
+		}
+		for (uint8_t f = 0; f < FILTERS; f++) {
+			for (uint8_t n = 1; n <= SWEEP_MAX_INTERVAL; n++) {
+				for (uint8_t db = 0; db <= SWEEP_MAX_DEBOUNCE; db++) {
+					sweepResult *r = &results[count++];
+					double latencySum = 0;
+					uint32_t latencyCount = 0, worst = 0;
+
+					r->cfg = (sweepConfig){db, tol, f, n};
+					for (int s = 0; s < sets; s++) {
+						run(&r->cfg, &data[s], r, &latencySum, &latencyCount, &worst);
+					}
+					r->meanMs = latencyCount ? ms(latencySum / latencyCount) : 1e9;
+					r->worstMs = ms(worst);
+					r->errors = 1000.0 * (r->falsePresses + r->missed + r->doubled) / totalPresses;
+				}
+			}
+		}
+	}
+	setTolerance(TOLLERANCE);
+
+	for (int a = 0; a < count; a++) {
+		results[a].front = 1;
+		for (int b = 0; b < count && results[a].front; b++) {
+			if (dominates(&results[b], &results[a])) {
+				results[a].front = 0;
+			}
+		}
+		front += results[a].front;
+	}
+	qsort(results, count, sizeof(*results), order);
+
+	printf("%d configurations (%d skipped, windows touch), %d on the front\n", count, skipped, front);
+	printf("  samples       tol filter   every     mean    worst  errors/1k  false  miss  dbl\n");
+	for (int a = 0; a < count; a++) {
+		if (all || results[a].front || shipped(&results[a].cfg)) {
+			print(&results[a]);
+		}
+	}
+
+	free(results);
+	for (int s = 0; s < sets; s++) {
+		free(data[s].adc);
+		free(data[s].truth);
+	}
+	return 0;
+}
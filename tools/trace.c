@@ -0,0 +1,131 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include <string.h>
+#include "trace.h"
+
+static void put16(FILE *f, uint16_t v)
+{
+	fputc(v & 0xFF, f);
+	fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, uint32_t v)
+{
+	put16(f, v & 0xFFFF);
+	put16(f, v >> 16);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Returns 0 if the file can't be opened or isn't a trace
+int traceOpenRead(traceFile *t, const char *path)
+{
+	uint8_t h[TRACE_HEADER_SIZE];
+
+	t->f = fopen(path, "rb");
+	if (!t->f) {
+		return 0;
+	}
+	if (fread(h, 1, sizeof(h), t->f) != sizeof(h) || memcmp(h, "ATRC", 4) != 0 || h[4] != TRACE_VERSION) {
+		fclose(t->f);
+		t->f = NULL;
+		return 0;
+	}
+	t->tickNs = get32(&h[8]);
+	t->samples = get32(&h[12]);
+	t->writing = 0;
+	return 1;
+}
+
+// Returns 0 at the end of the trace
+int traceRead(traceFile *t, traceRecord *r)
+{
+	int lo = fgetc(t->f), hi = fgetc(t->f);
+	uint16_t v;
+
+	if (lo == EOF || hi == EOF) {
+		return 0;
+	}
+	v = lo | hi << 8;
+	if (v & TRACE_TRUTH) {
+		r->type = TRACE_MARK;
+		r->delta = 0;
+		r->value = v & 0xFF;
+	} else {
+		r->type = TRACE_SAMPLE;
+		r->delta = (v >> TRACE_DELTA_SHIFT) & TRACE_DELTA_MAX;
+		r->value = v & 0x3FF;
+	}
+	return 1;
+}
+
+int traceOpenWrite(traceFile *t, const char *path, uint32_t tickNs)
+{
+	t->f = fopen(path, "wb");
+	if (!t->f) {
+		return 0;
+	}
+	t->tickNs = tickNs;
+	t->samples = 0;
+	t->writing = 1;
+	t->last = 0;
+	t->mark = -1;
+	fwrite("ATRC", 1, 4, t->f);
+	fputc(TRACE_VERSION, t->f);
+	fputc(0, t->f);
+	put16(t->f, 0);
+	put32(t->f, tickNs);
+	put32(t->f, 0);		// filled in by traceClose()
+	return 1;
+}
+
+static void flushMark(traceFile *t)
+{
+	if (t->mark >= 0) {
+		put16(t->f, TRACE_TRUTH | t->mark);
+		t->mark = -1;
+	}
+}
+
+// Gaps longer than TRACE_DELTA_MAX are split: the ticks in between read as the sample before, and only the
+// last record, after any truth mark waiting for it, carries adc
+void traceWriteSample(traceFile *t, uint16_t adc, uint32_t delta)
+{
+	while (delta > TRACE_DELTA_MAX) {
+		put16(t->f, (t->last & 0x3FF) | TRACE_DELTA_MAX << TRACE_DELTA_SHIFT);
+		t->samples++;
+		delta -= TRACE_DELTA_MAX;
+	}
+	flushMark(t);
+	put16(t->f, (adc & 0x3FF) | (uint16_t)delta << TRACE_DELTA_SHIFT);
+	t->samples++;
+	t->last = adc;
+}
+
+// Held until the next sample is written, so it lands in front of that sample rather than a gap before it
+void traceWriteMark(traceFile *t, uint8_t state)
+{
+	flushMark(t);
+	t->mark = state;
+}
+
+void traceClose(traceFile *t)
+{
+	if (t->f) {
+		if (t->writing) {
+			flushMark(t);
+		}
+		if (t->writing && fseek(t->f, 12, SEEK_SET) == 0) {
+			put32(t->f, t->samples);
+		}
+		fclose(t->f);
+		t->f = NULL;
+	}
+}
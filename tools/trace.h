@@ -0,0 +1,67 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+ADC trace files, for replaying real wheel behaviour through the host build (tools/replay.c).
+
+Header, 16 bytes, little endian:
+	"ATRC"		magic
+	version		uint8, TRACE_VERSION
+	flags		uint8, 0
+	reserved	uint16, 0
+	tickNs		uint32, time between samples the trace was taken at (the firmware tick, 527000)
+	samples		uint32, number of sample records, 0 if not known
+Then 16 bit little endian records:
+	bit 15 = 0	sample: bits 0-9 ADC reading, bits 10-14 ticks since the previous sample (1-31, ignored on
+				the first); ticks that were skipped read the same as the sample before
+	bit 15 = 1	truth mark: bits 0-7 the state (VAL_*) the driver was really holding from the next sample
+				on, as noted by whoever recorded it; bits 8-14 zero
+A trace without truth marks still replays, but false positives and latency can't be scored.
+
+Any logger that samples the ladder at the tick rate will do.  replay -c converts the CSV such loggers
+usually produce ("tick,adc[,state]" per line) into this format.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_VERSION		1
+#define TRACE_HEADER_SIZE	16
+
+#define TRACE_TRUTH			0x8000
+#define TRACE_DELTA_SHIFT	10
+#define TRACE_DELTA_MAX		31
+
+enum {TRACE_SAMPLE, TRACE_MARK};
+
+struct trace_file {
+	FILE *f;
+	uint32_t tickNs;
+	uint32_t samples;
+	uint8_t writing;
+	uint16_t last;		// writing: the sample before, which ticks skipped over read as
+	int16_t mark;		// writing: truth mark held for the next sample, -1 for none
+};
+typedef struct trace_file traceFile;
+
+struct trace_record {
+	uint8_t type;		// TRACE_SAMPLE or TRACE_MARK
+	uint8_t delta;		// sample: ticks since the previous one
+	uint16_t value;		// sample: ADC reading, mark: state
+};
+typedef struct trace_record traceRecord;
+
+int traceOpenRead(traceFile *t, const char *path);
+int traceRead(traceFile *t, traceRecord *r);
+int traceOpenWrite(traceFile *t, const char *path, uint32_t tickNs);
+void traceWriteSample(traceFile *t, uint16_t adc, uint32_t delta);
+void traceWriteMark(traceFile *t, uint8_t state);
+void traceClose(traceFile *t);
+
+#endif
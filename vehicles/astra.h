@@ -0,0 +1,23 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Holden Astra steering wheel ladder.
+Raw resistance values with 5v source and 458 ohm (measured) resistor.
+*/
+
+#define LADDER_NAME		"Holden Astra"
+#define LADDER_PULLUP	458		// ohms, 5v to the ADC pin
+#define LADDER_IDLE		3652	// ohms, nothing pressed
+
+// state, ohms - highest resistance (highest ADC value) first
+#define LADDER_BUTTONS(B) \
+	B(VAL_SRC,		1466)	/* up */ \
+	B(VAL_SEEKBK,	790)	/* back */ \
+	B(VAL_SEEKFWD,	466)	/* fwd */ \
+	B(VAL_SOUND,	283)	/* O/0 */ \
+	B(VAL_VOLUP,	163)	/* + */ \
+	B(VAL_VOLDN,	83)		/* - */
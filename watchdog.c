@@ -0,0 +1,50 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+#include "watchdog.h"
+
+#if OPT_WATCHDOG
+
+#include <avr/io.h>
+
+// Not cleared by the C runtime, so they still hold what they did when the watchdog fired
+watchdogInfo watchdogLast __attribute__((section(".noinit")));
+volatile uint8_t watchdogStage __attribute__((section(".noinit")));
+static uint8_t resetFlags __attribute__((section(".noinit")));
+uint8_t watchdogChains;
+
+// After a watchdog reset WDRF keeps the watchdog on at its shortest timeout, which would reset again before
+// main() could get to it; clear it and turn it off before the C runtime starts
+void watchdogEarly(void) __attribute__((naked, used, section(".init3")));
+void watchdogEarly(void)
+{
+	resetFlags = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+}
+
+// First thing in main().  Returns non-zero unless this is a power up or brown-out.
+uint8_t watchdogInit(void)
+{
+	uint8_t restart = !(resetFlags & (_BV(PORF) | _BV(BORF)));
+
+	watchdogLast.cause = resetFlags;
+	if (!restart) {
+		// .noinit RAM is random after a power cycle
+		watchdogLast.stage = WDT_STAGE_NONE;
+		watchdogLast.resets = 0;
+	} else {
+		watchdogLast.stage = watchdogStage;
+		if ((resetFlags & _BV(WDRF)) && watchdogLast.resets != 0xFF) {
+			watchdogLast.resets++;
+		}
+	}
+	watchdogStage = WDT_STAGE_INIT;
+	wdt_enable(WATCHDOG_WDTO);
+	return restart;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+(c) Mark Smith 2018
+GPL v3
+Not licensed for commercial use
+*/
+
+/*
+Watchdog supervision.
+
+A wait that never ends (the tick ISR stopped, so waitForTick() or the main loop sits on tick == 0 for ever)
+would otherwise leave the bridge dead until the radio is switched off and on.  With OPT_WATCHDOG the watchdog
+runs in system reset mode and WATCHDOG_RESET() is called once per tick by the main loop, once per tick by
+waitForTick() and before each EEPROM byte is written, so a hang costs WATCHDOG_TIMEOUT_MS and a reset.
+
+The ticks carrying on doesn't mean the buttons are still being read: if ADC_vect stops coming, the chain stays
+busy, ADCStart() only counts overruns and adcDecoded[] holds its last state for ever.  So WATCHDOG_RESET()
+only resets the watchdog when adcChains has moved on since the last time it did.  A chain finishes every
+tick, so in the main loop that is every call; a chain that overruns its tick costs one reset.
+
+Timeout: the longest the firmware goes between resets is a tick plus the slowest thing done inside one, which
+is waiting for the previous EEPROM byte write to finish (3.4ms, calibration save) followed by decodeBuild()
+working out the chord windows with OPT_CHORDS.  decodeBuild() is counted in cycles, so it follows F_CPU: ~6ms
+at 8MHz for the Astra's 15 pairs, ~45ms at 1MHz.  The watchdog runs from its own ~128kHz oscillator which
+moves with supply and temperature, so the timeout picked is the shortest that is at least WATCHDOG_MARGIN
+times that.
+
+What the firmware was doing is kept in watchdogStage, in .noinit RAM so it survives the reset.  At the next
+start watchdogLast holds MCUSR and the stage it was caught in, along with a count of watchdog resets since
+power up; with OPT_TELEMETRY they go out as a TLM_RESET record.  After anything other than a power up or
+brown-out the bridge goes straight back to sampling: the calibration is loaded but a held button isn't taken
+as a request for learning mode.
+
+Reading it without telemetry: watchdogLast and watchdogStage are plain globals, read them by symbol.
+*/
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+#include "config.h"
+#include "timing.h"
+#include "decode.h"
+
+// What the firmware is doing, in watchdogStage
+enum {
+	WDT_STAGE_NONE,			// not caught by the watchdog (watchdogLast only)
+	WDT_STAGE_INIT,			// main() up to the main loop
+	WDT_STAGE_CALIBRATE,	// calibrateStartup(), including learning mode
+	WDT_STAGE_WAIT_TICK,	// waitForTick()
+	WDT_STAGE_EEPROM,		// writing a settings block
+	WDT_STAGE_IDLE,			// main loop waiting for the next tick
+	WDT_STAGE_DEBOUNCE,		// main loop, debounce
+	WDT_STAGE_DISPATCH,		// main loop, keymap and queueing commands
+	WDT_STAGE_SERVICE,		// main loop, tick calibration, temperature trim and telemetry
+	WDT_STAGES
+};
+
+struct watchdog_info {
+	uint8_t cause;		// MCUSR at the last reset: PORF, EXTRF, BORF, WDRF bits
+	uint8_t stage;		// watchdogStage when it happened, WDT_STAGE_NONE after a power up or brown-out
+	uint8_t resets;		// watchdog resets since power up, stops at 0xFF
+};
+typedef struct watchdog_info watchdogInfo;
+
+// Longest between watchdog resets, see above
+#define WATCHDOG_EEPROM_NS	3400000UL	// one EEPROM byte erase and write
+#define WATCHDOG_DIV_CYCLES		700		// one 32 bit division (libgcc), rounded up
+#define WATCHDOG_CHECK_CYCLES	40		// one overlap check, with its share of the sort
+// decodeBuild(): three divisions per pair, then each pair checked against idle, the buttons and every pair
+#define WATCHDOG_CHORD_CYCLES	(3 * WATCHDOG_DIV_CYCLES \
+								+ (1 + DECODE_BUTTONS + DECODE_CHORDS) * WATCHDOG_CHECK_CYCLES)
+#define WATCHDOG_CHORDS_NS	(DECODE_CHORDS * WATCHDOG_CHORD_CYCLES * 1000000000ULL / F_CPU)
+#define WATCHDOG_WORST_NS	(TICK_NS + WATCHDOG_EEPROM_NS + WATCHDOG_CHORDS_NS)
+#define WATCHDOG_MARGIN		4
+
+#define WATCHDOG_NEEDED_MS	((WATCHDOG_WORST_NS * WATCHDOG_MARGIN + 999999UL) / 1000000UL)
+
+// Nominal timeouts at 5v
+#if WATCHDOG_NEEDED_MS <= 16
+#define WATCHDOG_WDTO		WDTO_15MS
+#define WATCHDOG_TIMEOUT_MS	16
+#elif WATCHDOG_NEEDED_MS <= 32
+#define WATCHDOG_WDTO		WDTO_30MS
+#define WATCHDOG_TIMEOUT_MS	32
+#elif WATCHDOG_NEEDED_MS <= 64
+#define WATCHDOG_WDTO		WDTO_60MS
+#define WATCHDOG_TIMEOUT_MS	64
+#elif WATCHDOG_NEEDED_MS <= 125
+#define WATCHDOG_WDTO		WDTO_120MS
+#define WATCHDOG_TIMEOUT_MS	125
+#elif WATCHDOG_NEEDED_MS <= 250
+#define WATCHDOG_WDTO		WDTO_250MS
+#define WATCHDOG_TIMEOUT_MS	250
+#else
+#error "Longest time between watchdog resets is too long for a quick recovery"
+#endif
+
+#if OPT_WATCHDOG
+
+#include <avr/wdt.h>
+#include "adc.h"
+
+extern watchdogInfo watchdogLast;
+extern volatile uint8_t watchdogStage;
+extern uint8_t watchdogChains;		// adcChains at the last reset
+
+uint8_t watchdogInit(void);
+
+#define WATCHDOG_RESET()		do { \
+									if (adcChains != watchdogChains) { \
+										watchdogChains = adcChains; \
+										wdt_reset(); \
+									} \
+								} while (0)
+#define WATCHDOG_STAGE(stage)	(watchdogStage = (stage))
+
+#else
+
+#define WATCHDOG_RESET()
+#define WATCHDOG_STAGE(stage)
+
+#endif
+
+#endif